@@ -2,6 +2,9 @@
 #include "RapiSender.h"
 #include "openevse.h"
 #include "input.h"
+#include "sim_evse.h"
+
+#include <map>
 
 #define dbgprint(s) DBUG(s)
 #define dbgprintln(s) DBUGLN(s)
@@ -11,9 +14,22 @@
 
 extern long pilot;
 extern long state;
+extern double amps;
 
 static CommandItem commandQueueItems[RAPI_MAX_COMMANDS];
 
+static std::map<Stream *, SimulatedEvse *> simulatedEvses;
+
+void sim_evse_attach(Stream *port, SimulatedEvse *evse)
+{
+  simulatedEvses[port] = evse;
+}
+
+void sim_evse_detach(Stream *port)
+{
+  simulatedEvses.erase(port);
+}
+
 RapiSender::RapiSender(Stream * stream) :
   _stream(stream),
   _sent(0),
@@ -94,6 +110,12 @@ RapiSender::sendCmdSync(String &cmd, unsigned long timeout)
   static char zero[] = "0";
   static char buf1[32];
 
+  auto it = simulatedEvses.find(_stream);
+  SimulatedEvse *evse = it != simulatedEvses.end() ? it->second : NULL;
+  long &pilot = evse ? evse->pilot : ::pilot;
+  long &state = evse ? evse->state : ::state;
+  double &amps = evse ? evse->amps : ::amps;
+
   switch (cmd[1])
   {
     case 'G':
@@ -119,9 +141,12 @@ RapiSender::sendCmdSync(String &cmd, unsigned long timeout)
         } break;
         case 'G':
         {
+          // Current in mA, the voltage is left to the simulator
+          sprintf(buf1, "%ld", (long)(amps * 1000));
           _tokens[0] = ok;
-          _tokens[1] = zero;
-          _tokenCnt = 2;
+          _tokens[1] = buf1;
+          _tokens[2] = zero;
+          _tokenCnt = 3;
         } break;
         case 'V':
         {
@@ -1,6 +1,15 @@
 #include <iostream>
+#include <cstring>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <ftw.h>
 #include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <thread>
 
 #include "StdioSerial.h"
 #include "RapiSender.h"
@@ -8,10 +17,19 @@
 #include "divert.h"
 #include "event.h"
 #include "event_log.h"
+#include "meter_mailbox.h"
 #include "manual.h"
 
 #include "parser.hpp"
 #include "cxxopts.hpp"
+#include "sim_summary.h"
+#include "sim_input.h"
+#include "sim_dataset.h"
+#include "sim_generator.h"
+#include "sim_clock.h"
+#include "sim_vehicle.h"
+#include "sim_site.h"
+#include "current_shaper.h"
 
 #include <MicroTasks.h>
 #include <EpoxyFS.h>
@@ -28,58 +46,45 @@ ManualOverride manual(evse);
 long pilot = 32;                      // OpenEVSE Pilot Setting
 long state = OPENEVSE_STATE_CONNECTED; // OpenEVSE State
 double voltage = 240; // Voltage from OpenEVSE or MQTT
+double amps = 0;      // Current the vehicle is drawing, reported by the fake RAPI $GG
+int solar = 0;        // The sample handed to divert through meterMailbox
+int grid_ie = 0;
 
 extern double smoothed_available_current;
 
 int date_col = 0;
 int grid_ie_col = -1;
+int live_pwr_col = -1;
 int solar_col = 1;
 int voltage_col = 1;
 
 time_t simulated_time = 0;
-time_t last_time = 0;
 
 bool kw = false;
+bool event_clock = false;
+std::string vehicle;
 
-time_t parse_date(const char *dateStr)
+// Copy a field to a NULL terminated buffer, truncating if needed
+static void copy_field(char *buffer, size_t size, const char *start, const char *end)
 {
-  int y = 2020, M = 1, d = 1, h = 0, m = 0, s = 0;
-  char ampm[5];
-  if(6 != sscanf(dateStr, "%d-%d-%dT%d:%d:%dZ", &y, &M, &d, &h, &m, &s)) {
-    if(6 != sscanf(dateStr, "%d-%d-%dT%d:%d:%d+00:00", &y, &M, &d, &h, &m, &s)) {
-      if(6 != sscanf(dateStr, "%d-%d-%d %d:%d:%d", &y, &M, &d, &h, &m, &s)) {
-        if(3 != sscanf(dateStr, "%d:%d %s", &h, &m, ampm)) {
-          if(1 == sscanf(dateStr, "%d", &s)) {
-            return s;
-          }
-        } else {
-          y = 2020; M = 1; d = 1; s = 0;
-          if(12 == h) {
-            h -= 12;
-          }
-          if('P' == ampm[0]) {
-            h += 12;
-          }
-        }
-      }
-    }
+  size_t len = end - start;
+  if(len > size - 1) {
+    len = size - 1;
   }
-
-  tm time = {0};
-  time.tm_year = y - 1900; // Year since 1900
-  time.tm_mon = M - 1;     // 0-11
-  time.tm_mday = d;        // 1-31
-  time.tm_hour = h;        // 0-23
-  time.tm_min = m;         // 0-59
-  time.tm_sec = s;         // 0-61 (0-60 in C++11)
-
-  return timegm(&time);
+  memcpy(buffer, start, len);
+  buffer[len] = '\0';
 }
 
-int get_watt(const char *val)
+// Parse a power value, sscanf would skip leading whitespace and ignore trailing characters
+// so do the same, but without needing the field to be copied to a std::string first
+int get_watt(const char *start, const char *end)
 {
-  float number = 0.0;
-  if(1 != sscanf(val, "%f", &number)) {
+  char buffer[64];
+  copy_field(buffer, sizeof(buffer), start, end);
+
+  char *number_end;
+  float number = strtof(buffer, &number_end);
+  if(number_end == buffer) {
     throw std::invalid_argument("Not a number");
   }
 
@@ -90,16 +95,650 @@ int get_watt(const char *val)
   return (int)round(number);
 }
 
+int get_voltage(const char *start, const char *end)
+{
+  char buffer[64];
+  copy_field(buffer, sizeof(buffer), start, end);
+
+  char *number_end;
+  long number = strtol(buffer, &number_end, 10);
+  if(number_end == buffer) {
+    throw std::invalid_argument("Not a number");
+  }
+
+  return (int)number;
+}
+
 time_t divertmode_get_time()
 {
   return simulated_time;
 }
 
+// Update the sample from a single field of the input, throws std::invalid_argument
+// if the field can not be parsed
+void parse_field(int col, const char *start, const char *end, DateParser &dates, SimulationSample &sample)
+{
+  if(date_col == col) {
+    if(!dates.parse(start, end, sample.time)) {
+      throw std::invalid_argument("Not a date");
+    }
+  } else if (grid_ie_col == col) {
+    sample.grid_ie = get_watt(start, end);
+  } else if (solar_col == col) {
+    sample.solar = get_watt(start, end);
+  } else if (voltage_col == col) {
+    sample.voltage = get_voltage(start, end);
+  } else if (live_pwr_col == col) {
+    sample.live_pwr = get_watt(start, end);
+  }
+}
+
+// Read the whole dataset into memory so it can be replayed by any number of runs.
+// Mapped files are tokenized in place, anything else (eg a pipe) is read with the
+// stream parser.
+void load_dataset(MappedFile &file, std::istream &input, char sep, SimulationDataset &dataset)
+{
+  DateParser dates;
+  SimulationSample sample = { 0, 0, 0, 0, voltage };
+
+  if(file.size() > 0)
+  {
+    CsvTokenizer tokenizer(file.begin(), file.end(), sep);
+    CsvField fields[CSV_MAX_FIELDS];
+    int count;
+
+    // Rough guess at the number of rows to avoid growing the dataset too many times
+    dataset.reserve(file.size() / 24);
+
+    while((count = tokenizer.nextRow(fields)) >= 0)
+    {
+      try
+      {
+        for(int col = 0; col < count; col++) {
+          parse_field(col, fields[col].start, fields[col].end, dates, sample);
+        }
+
+        dataset.push_back(sample);
+      }
+      catch(const std::invalid_argument& e)
+      {
+      }
+    }
+
+    return;
+  }
+
+  CsvParser parser(input);
+  parser.delimiter(sep);
+
+  for (auto& row : parser)
+  {
+    try
+    {
+      int col = 0;
+
+      for (auto& field : row)
+      {
+        parse_field(col, field.data(), field.data() + field.length(), dates, sample);
+        col++;
+      }
+
+      dataset.push_back(sample);
+    }
+    catch(const std::invalid_argument& e)
+    {
+    }
+  }
+}
+
+// Replay the dataset through the divert code, optionally writing the per sample CSV.
+//
+// The firmware modules are singletons (MicroTask, config, EVSE manager), so a run
+// owns the whole process, sweeps get their isolation by running each config in a
+// separate worker process.
+void run_simulation(SampleSource &dataset, std::ostream *output, SimulationSummary &summary, ShaperSummary *shaper_summary = NULL)
+{
+  time_t last_time = 0;
+  bool use_shaper = live_pwr_col >= 0;
+
+  solar = 0;
+  grid_ie = 0;
+  amps = 0;
+
+  // Without a vehicle model the EV is assumed to draw the full pilot while charging
+  VehicleModel ev;
+  bool use_vehicle = vehicle.length() > 0;
+  if(use_vehicle && !ev.deserialize(vehicle.c_str())) {
+    std::cerr << "Invalid vehicle model: " << vehicle << std::endl;
+    use_vehicle = false;
+  }
+
+  evse.begin();
+  divert.begin();
+
+  // Replay the house load as if it were the MQTT live power feed
+  if(use_shaper) {
+    shaper.begin(evse);
+    shaper.setState(true);
+  }
+
+  // Initialise the EVSE Manager
+  while (!evse.isConnected()) {
+    MicroTask.update();
+  }
+
+  divert.setMode(DivertMode::Eco);
+
+  // The energy meter total is persisted, only count the switches from this run
+  uint32_t start_switches = evse.getTotalSwitches();
+
+  if(output) {
+    *output << "Date,Solar,Grid IE,Pilot,Charge Power,Min Charge Power,State,Smoothed Available";
+    if(use_shaper) {
+      *output << ",Live Power,Shaper Max Current,Shaper Paused";
+    }
+    *output << std::endl;
+  }
+
+  SimulationSample sample;
+  dataset.rewind();
+  while(dataset.next(sample))
+  {
+    simulated_time = sample.time;
+    solar = sample.solar;
+    meterMailbox.store(MeterInput_Solar, solar);
+    grid_ie = sample.grid_ie;
+    voltage = sample.voltage;
+
+    if(last_time != 0)
+    {
+      int delta = simulated_time - last_time;
+      if(delta > 0)
+      {
+        if(use_vehicle) {
+          ev.charge(amps, voltage, delta);
+        }
+
+        if(event_clock) {
+          simClock.advanceTo(millis() + delta * 1000, []() {
+            MicroTask.update();
+          });
+        } else {
+          EpoxyTest::add_millis(delta * 1000);
+        }
+      }
+    }
+    last_time = simulated_time;
+
+    int ev_pilot = (OPENEVSE_STATE_CHARGING == state ? pilot : 0);
+    if(use_vehicle)
+    {
+      // The dataset is the site without the EV, so the grid meter sees the EV load on top
+      amps = ev.getCurrent(ev_pilot, voltage);
+      grid_ie += ev.getPower(amps, voltage);
+      evse.setVehicleStateOfCharge((int)ev.getSoc());
+    }
+
+    if(use_shaper)
+    {
+      // The live power is the house load plus the EV, the shaper adds the EV current back
+      if(!use_vehicle) {
+        amps = ev_pilot;
+      }
+      shaper.setLivePwr(sample.live_pwr + amps * voltage, millis());
+    }
+
+    // Stored rather than posted so divert is updated once per sample, from here
+    meterMailbox.store(MeterInput_GridIe, grid_ie);
+    divert.update_state(millis());
+    MicroTask.update();
+
+    ev_pilot = (OPENEVSE_STATE_CHARGING == state ? pilot : 0);
+    int ev_watt = ev_pilot * voltage;
+    if(use_vehicle) {
+      amps = ev.getCurrent(ev_pilot, voltage);
+      ev_watt = ev.getPower(amps, voltage);
+    } else if(use_shaper) {
+      amps = ev_pilot;
+    }
+
+    summary.update(simulated_time, solar, ev_watt, state);
+
+    bool shaper_paused = use_shaper && evse.getState(EvseClient_OpenEVSE_Shaper) == EvseState::Disabled;
+    if(use_shaper && shaper_summary) {
+      shaper_summary->update(simulated_time, sample.live_pwr + ev_watt, current_shaper_max_pwr, shaper_paused);
+    }
+
+    if(output)
+    {
+      tm tm;
+      gmtime_r(&simulated_time, &tm);
+
+      char buffer[32];
+      std::strftime(buffer, 32, "%d/%m/%Y %H:%M:%S", &tm);
+
+      int min_ev_watt = 6 * voltage;
+
+      double smoothed = divert.smoothedAvailableCurrent() * voltage;
+
+      *output << buffer << "," << solar << "," << grid_ie << "," << ev_pilot << "," << ev_watt << "," << min_ev_watt << "," << state << "," << smoothed;
+      if(use_shaper) {
+        *output << "," << (sample.live_pwr + ev_watt) << "," << shaper.getMaxCur() << "," << (shaper_paused ? 1 : 0);
+      }
+      *output << std::endl;
+    }
+  }
+
+  summary.setRelaySwitches(evse.getTotalSwitches() - start_switches);
+}
+
+// Simulate several chargers behind the one grid connection. The dataset is the site
+// without any EV load, the load of every charger is added to grid_ie so each divert
+// loop sees the other chargers as part of the house load.
+void run_site_simulation(SampleSource &dataset, std::ostream *output, std::vector<std::unique_ptr<SimulatedCharger>> &chargers, SimulationSummary &site)
+{
+  time_t last_time = 0;
+
+  solar = 0;
+  grid_ie = 0;
+
+  for(auto &charger : chargers) {
+    charger->begin();
+  }
+
+  // Initialise the EVSE Managers
+  bool connected = false;
+  while(!connected)
+  {
+    MicroTask.update();
+    connected = true;
+    for(auto &charger : chargers) {
+      connected = connected && charger->isConnected();
+    }
+  }
+
+  for(auto &charger : chargers) {
+    charger->setMode(DivertMode::Eco);
+  }
+
+  if(output)
+  {
+    *output << "Date,Solar,Grid IE,Charge Power";
+    for(size_t i = 1; i <= chargers.size(); i++) {
+      *output << ",Pilot " << i << ",State " << i;
+    }
+    *output << std::endl;
+  }
+
+  SimulationSample sample;
+  dataset.rewind();
+  while(dataset.next(sample))
+  {
+    simulated_time = sample.time;
+    solar = sample.solar;
+    meterMailbox.store(MeterInput_Solar, solar);
+    voltage = sample.voltage;
+
+    if(last_time != 0)
+    {
+      int delta = simulated_time - last_time;
+      if(delta > 0)
+      {
+        for(auto &charger : chargers) {
+          charger->charge(voltage, delta);
+        }
+
+        if(event_clock) {
+          simClock.advanceTo(millis() + delta * 1000, []() {
+            MicroTask.update();
+          });
+        } else {
+          EpoxyTest::add_millis(delta * 1000);
+        }
+      }
+    }
+    last_time = simulated_time;
+
+    double load = 0;
+    for(auto &charger : chargers) {
+      load += charger->updateLoad(voltage);
+    }
+    grid_ie = sample.grid_ie + load;
+
+    meterMailbox.store(MeterInput_GridIe, grid_ie);
+    for(auto &charger : chargers) {
+      charger->updateDivert();
+    }
+    MicroTask.update();
+
+    double site_watt = 0;
+    bool charging = false;
+    for(auto &charger : chargers)
+    {
+      double ev_watt = charger->updateLoad(voltage);
+      site_watt += ev_watt;
+      charger->getSummary().update(simulated_time, solar, ev_watt, charger->getState());
+      charging = charging || OPENEVSE_STATE_CHARGING == charger->getState();
+    }
+    site.update(simulated_time, solar, site_watt, charging ? OPENEVSE_STATE_CHARGING : OPENEVSE_STATE_CONNECTED);
+
+    if(output)
+    {
+      tm tm;
+      gmtime_r(&simulated_time, &tm);
+
+      char buffer[32];
+      std::strftime(buffer, 32, "%d/%m/%Y %H:%M:%S", &tm);
+
+      *output << buffer << "," << solar << "," << grid_ie << "," << site_watt;
+      for(auto &charger : chargers) {
+        *output << "," << charger->getPilot() << "," << charger->getState();
+      }
+      *output << std::endl;
+    }
+  }
+}
+
+// Expand the sweep definition into a list of config overrides. The sweep is either an
+// array of config objects or an object of option names to arrays of values, in which
+// case every combination of the values is simulated.
+bool load_sweep(std::string &sweep, std::vector<std::string> &configs)
+{
+  // If the sweep is not a JSON string, assume it is a file name
+  if(sweep.length() > 0 && sweep[0] != '{' && sweep[0] != '[')
+  {
+    std::ifstream t(sweep);
+    std::stringstream buffer;
+    buffer << t.rdbuf();
+    sweep = buffer.str();
+  }
+
+  DynamicJsonDocument doc(sweep.length() * 2 + 1024);
+  DeserializationError error = deserializeJson(doc, sweep);
+  if(error) {
+    std::cerr << "Failed to parse sweep: " << error.c_str() << std::endl;
+    return false;
+  }
+
+  if(doc.is<JsonArray>())
+  {
+    for(JsonObject config : doc.as<JsonArray>())
+    {
+      std::string json;
+      serializeJson(config, json);
+      configs.push_back(json);
+    }
+    return true;
+  }
+
+  if(doc.is<JsonObject>())
+  {
+    JsonObject grid = doc.as<JsonObject>();
+    size_t combinations = 1;
+    for(JsonPair kv : grid)
+    {
+      size_t count = kv.value().is<JsonArray>() ? kv.value().size() : 1;
+      if(0 == count) {
+        return true;
+      }
+      combinations *= count;
+    }
+
+    for(size_t i = 0; i < combinations; i++)
+    {
+      StaticJsonDocument<1024> config;
+      size_t index = i;
+      for(JsonPair kv : grid)
+      {
+        if(kv.value().is<JsonArray>()) {
+          JsonArray values = kv.value().as<JsonArray>();
+          config[kv.key().c_str()] = values[index % values.size()];
+          index /= values.size();
+        } else {
+          config[kv.key().c_str()] = kv.value();
+        }
+      }
+
+      std::string json;
+      serializeJson(config, json);
+      configs.push_back(json);
+    }
+    return true;
+  }
+
+  std::cerr << "Sweep must be a JSON array or object" << std::endl;
+  return false;
+}
+
+std::string csv_quote(const std::string &value)
+{
+  std::string quoted = "\"";
+  for(char c : value)
+  {
+    if('"' == c) {
+      quoted += '"';
+    }
+    quoted += c;
+  }
+  quoted += '"';
+  return quoted;
+}
+
+static int remove_path(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+  return remove(path);
+}
+
+// Run each config in its own worker process, up to `jobs` at a time. The dataset is
+// loaded before forking so the workers share the parsed samples rather than each
+// re-reading the input.
+//
+// Each worker runs in its own directory with its own EpoxyFS root, the event log,
+// its manifest and temporary file and the energy meter file would otherwise be
+// written by every worker at once.
+int run_sweep(SampleSource &dataset, const std::vector<std::string> &configs, unsigned int jobs)
+{
+  std::vector<std::string> results(configs.size());
+  std::map<pid_t, std::pair<size_t, int>> running;
+  int failed = 0;
+
+  const char *tmp = getenv("TMPDIR");
+  std::string sweep_dir = std::string(tmp ? tmp : "/tmp") + "/divert_sim_XXXXXX";
+  if(NULL == mkdtemp(&sweep_dir[0])) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+
+  auto reap = [&]()
+  {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    auto it = running.find(pid);
+    if(it == running.end()) {
+      return;
+    }
+
+    size_t index = it->second.first;
+    int fd = it->second.second;
+    running.erase(it);
+
+    char buffer[512];
+    ssize_t len;
+    while((len = read(fd, buffer, sizeof(buffer))) > 0) {
+      results[index].append(buffer, len);
+    }
+    close(fd);
+
+    if(!WIFEXITED(status) || 0 != WEXITSTATUS(status) || results[index].empty()) {
+      std::cerr << "Simulation failed for config: " << configs[index] << std::endl;
+      failed++;
+    }
+  };
+
+  std::cout.flush();
+  std::cerr.flush();
+
+  for(size_t i = 0; i < configs.size(); i++)
+  {
+    while(running.size() >= jobs) {
+      reap();
+    }
+
+    int fds[2];
+    if(0 != pipe(fds)) {
+      perror("pipe");
+      nftw(sweep_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+      return EXIT_FAILURE;
+    }
+
+    std::string job_dir = sweep_dir + "/" + std::to_string(i);
+    std::string fs_root = job_dir + "/epoxyfsdata";
+
+    pid_t pid = fork();
+    if(0 == pid)
+    {
+      close(fds[0]);
+
+      if(0 != mkdir(job_dir.c_str(), 0700) || 0 != mkdir(fs_root.c_str(), 0700) || 0 != chdir(job_dir.c_str())) {
+        perror(job_dir.c_str());
+        _exit(EXIT_FAILURE);
+      }
+      setenv("EPOXY_FS_ROOT", fs_root.c_str(), 1);
+      fs::EpoxyFS.begin();
+
+      config_deserialize(configs[i].c_str());
+
+      SimulationSummary summary;
+      run_simulation(dataset, NULL, summary);
+
+      std::stringstream row;
+      summary.printCsv(row);
+      std::string out = row.str();
+      ssize_t written = write(fds[1], out.c_str(), out.length());
+      close(fds[1]);
+
+      // Skip the static destructors, the parent still owns the shared state
+      _exit(written == (ssize_t)out.length() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    else if(pid < 0)
+    {
+      perror("fork");
+      close(fds[0]);
+      close(fds[1]);
+      nftw(sweep_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+      return EXIT_FAILURE;
+    }
+
+    close(fds[1]);
+    running[pid] = std::make_pair(i, fds[0]);
+  }
+
+  while(running.size() > 0) {
+    reap();
+  }
+
+  nftw(sweep_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+
+  std::cout << "\"Config\",";
+  SimulationSummary::printCsvHeader(std::cout);
+  std::cout << std::endl;
+  for(size_t i = 0; i < configs.size(); i++) {
+    std::cout << csv_quote(configs[i]) << "," << results[i] << std::endl;
+  }
+
+  return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Run a multi charger site, reporting the per charger and site summaries. The vehicle
+// option may be an array of models, which are given to the chargers in turn.
+int run_site(SampleSource &dataset, int count, const std::string &output, bool summary_csv, bool summary_json)
+{
+  DynamicJsonDocument vehicles(vehicle.length() * 2 + 1024);
+  if(vehicle.length() > 0 && deserializeJson(vehicles, vehicle)) {
+    std::cerr << "Invalid vehicle model: " << vehicle << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::unique_ptr<SimulatedCharger>> chargers;
+  for(int i = 0; i < count; i++)
+  {
+    std::unique_ptr<SimulatedCharger> charger(new SimulatedCharger(eventLog));
+    if(vehicle.length() > 0)
+    {
+      std::string json;
+      if(vehicles.is<JsonArray>()) {
+        serializeJson(vehicles[i % vehicles.size()], json);
+      } else {
+        serializeJson(vehicles, json);
+      }
+      if(!charger->setVehicle(json.c_str())) {
+        std::cerr << "Invalid vehicle model: " << json << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    chargers.push_back(std::move(charger));
+  }
+
+  std::ofstream output_file;
+  std::ostream *samples = (summary_csv || summary_json) ? NULL : &std::cout;
+  if(output.length() > 0)
+  {
+    output_file.open(output);
+    if(!output_file) {
+      std::cerr << "Failed to open " << output << std::endl;
+      return EXIT_FAILURE;
+    }
+    samples = &output_file;
+  }
+
+  SimulationSummary site;
+  run_site_simulation(dataset, samples, chargers, site);
+
+  if(summary_csv)
+  {
+    std::cout << "\"Charger\",";
+    SimulationSummary::printCsvHeader(std::cout);
+    std::cout << std::endl;
+    for(int i = 0; i < count; i++) {
+      std::cout << (i + 1) << ",";
+      chargers[i]->getSummary().printCsv(std::cout);
+      std::cout << std::endl;
+    }
+    std::cout << "\"Site\",";
+    site.printCsv(std::cout);
+    std::cout << std::endl;
+  }
+
+  if(summary_json)
+  {
+    DynamicJsonDocument doc(512 * (count + 1));
+    StaticJsonDocument<256> summary;
+    site.serialize(summary);
+    doc["site"] = summary;
+    JsonArray array = doc.createNestedArray("chargers");
+    for(auto &charger : chargers) {
+      summary.clear();
+      charger->getSummary().serialize(summary);
+      array.add(summary);
+    }
+    serializeJson(doc, std::cout);
+    std::cout << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv)
 {
   int voltage_arg = -1;
   std::string sep = ",";
   std::string config;
+  std::string sweep;
+  std::string input;
+  std::string output;
+  std::string generate;
+  unsigned int jobs = std::thread::hardware_concurrency();
+  int chargers = 1;
 
   cxxopts::Options options(argv[0], " - example command line options");
   options
@@ -112,10 +751,21 @@ int main(int argc, char** argv)
     ("d,date", "The date column", cxxopts::value<int>(date_col), "N")
     ("s,solar", "The solar column", cxxopts::value<int>(solar_col), "N")
     ("g,gridie", "The Grid IE column", cxxopts::value<int>(grid_ie_col), "N")
+    ("l,livepwr", "The house load column, replayed to the current shaper as the MQTT live power", cxxopts::value<int>(live_pwr_col), "N")
     ("c,config", "Config options, either a file name or JSON", cxxopts::value<std::string>(config))
     ("v,voltage", "The Voltage column if < 50, else the fixed voltage", cxxopts::value<int>(voltage_arg), "N")
     ("kw", "values are KW")
+    ("vehicle", "Model the vehicle battery, JSON or a file name, eg {\"capacity\":60,\"soc\":20}", cxxopts::value<std::string>(vehicle))
+    ("chargers", "Simulate N chargers sharing the grid connection", cxxopts::value<int>(chargers), "N")
+    ("event-clock", "Run the task wakeups between samples rather than jumping from sample to sample")
     ("sep", "Field separator", cxxopts::value<std::string>(sep))
+    ("i,input", "Read the dataset from a file rather than stdin", cxxopts::value<std::string>(input))
+    ("generate", "Generate a synthetic dataset (JSON options) rather than reading one, -g and -l select if the generated grid IE and house load are used", cxxopts::value<std::string>(generate))
+    ("o,output", "Write the per sample CSV to a file rather than stdout", cxxopts::value<std::string>(output))
+    ("summary", "Output a CSV summary of the run rather than the per sample CSV")
+    ("summary-json", "Output a JSON summary of the run rather than the per sample CSV")
+    ("sweep", "Run each config in the sweep (file name or JSON) and output a summary row per config", cxxopts::value<std::string>(sweep))
+    ("j,jobs", "Number of sweep configs to simulate in parallel", cxxopts::value<unsigned int>(jobs), "N")
     ("config-check", "Output the config and exit")
     ("config-load", "Simulate loading config from EEPROM")
     ("config-commit", "Simulate saving the config to EEPROM");
@@ -152,7 +802,7 @@ int main(int argc, char** argv)
     config_commit();
   }
 
-  if(result.count("config-check")) 
+  if(result.count("config-check"))
   {
     String config_out;
     config_serialize(config_out, true, false, false);
@@ -161,9 +811,19 @@ int main(int argc, char** argv)
   }
 
   kw = result.count("kw") > 0;
+  event_clock = result.count("event-clock") > 0;
+
+  // If the vehicle is not a JSON string, assume it is a file name
+  if(vehicle.length() > 0 && vehicle[0] != '{')
+  {
+    std::ifstream t(vehicle);
+    std::stringstream buffer;
+    buffer << t.rdbuf();
+    vehicle = buffer.str();
+  }
 
   divert_type = grid_ie_col >= 0 ? 1 : 0;
-  
+
   if(voltage_arg >= 0) {
     if(voltage_arg < 50) {
       voltage_col = voltage_arg;
@@ -172,81 +832,109 @@ int main(int argc, char** argv)
     }
   }
 
-  solar = 0;
-  grid_ie = 0;
-
-  evse.begin();
-  divert.begin();
-
-  // Initialise the EVSE Manager
-  while (!evse.isConnected()) {
-    MicroTask.update();
+  std::vector<std::string> sweep_configs;
+  if(result.count("sweep") > 0 && !load_sweep(sweep, sweep_configs)) {
+    return EXIT_FAILURE;
   }
 
-  divert.setMode(DivertMode::Eco);
-
-  CsvParser parser(std::cin);
-  parser.delimiter(sep.c_str()[0]);
-  int row_number = 0;
+  SimulationDataset loaded;
+  DatasetSource dataset_source(loaded);
+  SyntheticDataset generator;
+  SampleSource *source = &dataset_source;
 
-  std::cout << "Date,Solar,Grid IE,Pilot,Charge Power,Min Charge Power,State,Smoothed Available" << std::endl;
-  for (auto& row : parser)
+  if(result.count("generate") > 0)
   {
-    try
-    {
-      int col = 0;
-      std::string val;
+    // Generated samples are streamed straight in to the simulation
+    if(!generator.deserialize(generate.c_str())) {
+      std::cerr << "Invalid generator options: " << generate << std::endl;
+      return EXIT_FAILURE;
+    }
+    source = &generator;
+  }
+  else
+  {
+    // Map the input if we can, stdin redirected from a file can be mapped directly
+    MappedFile file;
+    if(input.length() > 0) {
+      if(!file.open(input.c_str())) {
+        std::cerr << "Failed to open " << input << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else {
+      file.open(STDIN_FILENO);
+    }
 
-      for (auto& field : row)
-      {
-        val = field;
-        if(date_col == col) {
-          simulated_time = parse_date(val.c_str());
-        } else if (grid_ie_col == col) {
-          grid_ie = get_watt(val.c_str());
-        } else if (solar_col == col) {
-          solar = get_watt(val.c_str());
-        } else if (voltage_col == col) {
-          voltage = stoi(field);
-        }
+    load_dataset(file, std::cin, sep.c_str()[0], loaded);
+  }
 
-        col++;
-      }
+  SampleSource &dataset = *source;
 
-      if(last_time != 0)
-      {
-        int delta = simulated_time - last_time;
-        if(delta > 0) {
-          EpoxyTest::add_millis(delta * 1000);
-        }
-      }
-      last_time = simulated_time;
+  if(result.count("sweep") > 0 && chargers > 1) {
+    std::cerr << "Sweeps of multiple chargers are not supported" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-      divert.update_state();
-      MicroTask.update();
+  if(result.count("sweep") > 0) {
+    return run_sweep(dataset, sweep_configs, jobs > 0 ? jobs : 1);
+  }
 
-      tm tm;
-      gmtime_r(&simulated_time, &tm);
+  bool summary_csv = result.count("summary") > 0;
+  bool summary_json = result.count("summary-json") > 0;
 
-      char buffer[32];
-      std::strftime(buffer, 32, "%d/%m/%Y %H:%M:%S", &tm);
+  if(chargers > 1 && live_pwr_col >= 0) {
+    std::cerr << "The current shaper is only simulated for a single charger" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-      int ev_pilot = (OPENEVSE_STATE_CHARGING == state ? pilot : 0);
-      int ev_watt = ev_pilot * voltage;
-      int min_ev_watt = 6 * voltage;
+  if(chargers > 1) {
+    return run_site(dataset, chargers, output, summary_csv, summary_json);
+  }
 
-      double smoothed = divert.smoothedAvailableCurrent() * voltage;
+  std::ofstream output_file;
+  std::ostream *samples = (summary_csv || summary_json) ? NULL : &std::cout;
+  if(output.length() > 0)
+  {
+    output_file.open(output);
+    if(!output_file) {
+      std::cerr << "Failed to open " << output << std::endl;
+      return EXIT_FAILURE;
+    }
+    samples = &output_file;
+  }
 
-      std::cout << buffer << "," << solar << "," << grid_ie << "," << ev_pilot << "," << ev_watt << "," << min_ev_watt << "," << state << "," << smoothed << std::endl;
+  SimulationSummary summary;
+  ShaperSummary shaper_summary;
+  bool use_shaper = live_pwr_col >= 0;
+  run_simulation(dataset, samples, summary, &shaper_summary);
+
+  if(summary_csv)
+  {
+    SimulationSummary::printCsvHeader(std::cout);
+    if(use_shaper) {
+      std::cout << ",";
+      ShaperSummary::printCsvHeader(std::cout);
     }
-    catch(const std::invalid_argument& e)
-    {
+    std::cout << std::endl;
+    summary.printCsv(std::cout);
+    if(use_shaper) {
+      std::cout << ",";
+      shaper_summary.printCsv(std::cout);
     }
+    std::cout << std::endl;
   }
-}
 
-void event_send(String event)
-{
+  if(summary_json)
+  {
+    StaticJsonDocument<512> doc;
+    summary.serialize(doc);
+    if(use_shaper) {
+      shaper_summary.serialize(doc);
+    }
+    serializeJson(doc, std::cout);
+    std::cout << std::endl;
+  }
+
+  return EXIT_SUCCESS;
 }
 
 void event_send(JsonDocument &event)
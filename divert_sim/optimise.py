@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Search the divert smoothing constants for the best trade off between solar use,
+relay switching and grid import, reporting the Pareto front for each dataset"""
+
+# pylint: disable=line-too-long
+
+import argparse
+import csv
+import json
+import os
+from os import path
+from subprocess import PIPE, Popen
+
+# The options searched and their default grid of values
+SEARCH_SPACE = {
+    'divert_attack_smoothing_time': [20, 60, 120, 300],
+    'divert_decay_smoothing_time': [20, 120, 300, 600, 900],
+    'divert_PV_ratio': [0.5, 0.8, 1.1, 1.5],
+    'divert_min_charge_time': [60, 300, 600, 1200]
+}
+
+INTEGER_OPTIONS = ['divert_attack_smoothing_time', 'divert_decay_smoothing_time', 'divert_min_charge_time']
+
+def evaluate(dataset: str, grid: dict, args) -> list:
+    """Run every combination of the grid against the dataset, in parallel across all cores"""
+
+    command = ["./divert_sim", "-i", dataset, "--sweep", json.dumps(grid)]
+    if args.jobs:
+        command += ["-j", str(args.jobs)]
+    if args.gridie:
+        command += ["-g", str(args.gridie)]
+    if args.solar:
+        command += ["-s", str(args.solar)]
+    if args.voltage:
+        command += ["-v", str(args.voltage)]
+    if args.sep:
+        command += ["--sep", args.sep]
+    if args.kw:
+        command.append("--kw")
+
+    divert_process = Popen(command, stdout=PIPE, stderr=PIPE, universal_newlines=True)
+    output = divert_process.communicate()[0]
+
+    results = []
+    for row in csv.DictReader(output.splitlines()):
+        results.append({
+            'config': json.loads(row['Config']),
+            'solar': float(row['Charge from solar (kWh)']),
+            'grid': float(row['Charge from grid (kWh)']),
+            'switches': int(row['Relay switches'])
+        })
+    return results
+
+def dominates(a: dict, b: dict) -> bool:
+    """True if a is at least as good as b on every objective and better on one"""
+    no_worse = a['solar'] >= b['solar'] and a['grid'] <= b['grid'] and a['switches'] <= b['switches']
+    better = a['solar'] > b['solar'] or a['grid'] < b['grid'] or a['switches'] < b['switches']
+    return no_worse and better
+
+def pareto_front(results: list) -> list:
+    """The results not dominated by any other result, best solar use first"""
+    front = [a for a in results if not any(dominates(b, a) for b in results)]
+    return sorted(front, key=lambda result: (-result['solar'], result['grid'], result['switches']))
+
+def refine(front: list, steps: int) -> dict:
+    """A new grid spanning the range of each option used by the front"""
+    grid = {}
+    for option in SEARCH_SPACE:
+        values = [result['config'][option] for result in front]
+        low, high = min(values), max(values)
+        if low == high:
+            grid[option] = [low]
+            continue
+        candidates = [low + ((high - low) * i) / (steps - 1) for i in range(steps)]
+        if option in INTEGER_OPTIONS:
+            candidates = [int(round(value)) for value in candidates]
+        else:
+            candidates = [round(value, 2) for value in candidates]
+        grid[option] = sorted(set(candidates))
+    return grid
+
+def optimise(dataset: str, args) -> list:
+    """Search the dataset, narrowing the grid around the front each round"""
+
+    print("Optimising dataset: " + dataset)
+
+    grid = dict(SEARCH_SPACE)
+    if args.space:
+        grid.update(json.loads(args.space))
+
+    seen = {}
+    front = []
+    for _ in range(args.rounds):
+        for result in evaluate(dataset, grid, args):
+            seen[json.dumps(result['config'], sort_keys=True)] = result
+
+        candidates = [result for result in seen.values()
+                      if (args.max_switches is None or result['switches'] <= args.max_switches) and
+                         (args.max_grid is None or result['grid'] <= args.max_grid)]
+        front = pareto_front(candidates)
+        if len(front) < 2:
+            break
+        grid = refine(front, args.steps)
+
+    return front
+
+def write_front(dataset: str, front: list) -> str:
+    """Write the front to output/pareto_<dataset>.csv"""
+    if not path.exists('output'):
+        os.mkdir('output')
+
+    name = path.splitext(path.basename(dataset))[0]
+    filename = path.join('output', 'pareto_' + name + '.csv')
+    with open(filename, 'w', encoding="utf-8", newline='') as front_file:
+        writer = csv.writer(front_file)
+        writer.writerow(list(SEARCH_SPACE.keys()) + ['Charge from solar (kWh)', 'Charge from grid (kWh)', 'Relay switches'])
+        for result in front:
+            writer.writerow([result['config'][option] for option in SEARCH_SPACE] +
+                            [result['solar'], result['grid'], result['switches']])
+    return filename
+
+def main():
+    """Optimise each of the datasets given on the command line"""
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('datasets', nargs='+', help='Dataset CSV files')
+    parser.add_argument('-g', '--gridie', type=int, help='The Grid IE column')
+    parser.add_argument('-s', '--solar', type=int, help='The solar column')
+    parser.add_argument('-v', '--voltage', type=int, help='The Voltage column if < 50, else the fixed voltage')
+    parser.add_argument('--sep', help='Field separator')
+    parser.add_argument('--kw', action='store_true', help='values are KW')
+    parser.add_argument('-j', '--jobs', type=int, default=0, help='Number of simulations to run in parallel, defaults to the number of cores')
+    parser.add_argument('--space', help='JSON object of options to lists of values, replacing the default search grid')
+    parser.add_argument('--rounds', type=int, default=3, help='Number of times to refine the grid around the front')
+    parser.add_argument('--steps', type=int, default=4, help='Values per option when refining the grid')
+    parser.add_argument('--max-switches', type=int, help='Discard candidates with more relay switches')
+    parser.add_argument('--max-grid', type=float, help='Discard candidates importing more kWh from the grid')
+    args = parser.parse_args()
+
+    for dataset in args.datasets:
+        front = optimise(dataset, args)
+        filename = write_front(dataset, front)
+        print(f"{len(front)} configs on the Pareto front, written to {filename}")
+        for result in front:
+            print(f"  {json.dumps(result['config'])}: solar {result['solar']:.2f} kWh, grid {result['grid']:.2f} kWh, {result['switches']} switches")
+
+if __name__ == '__main__':
+    main()
@@ -4,8 +4,9 @@
 
 from os import path
 import os
+import csv
+import json
 from subprocess import PIPE, Popen
-from datetime import datetime
 
 OPENEVSE_STATE_STARTING = 0
 OPENEVSE_STATE_NOT_CONNECTED = 1
@@ -42,106 +43,49 @@ def run_simulation(dataset: str,
                 solar_col: bool = False, voltage_col: bool = False,
                 separator: str = ',', is_kw: bool = False) -> None:
     """Run the divert_sim process on the given dataset and return the results"""
-    line_number = 0
-
-    last_date = None
-    last_state = 0
-    charge_start_date = None
-
-    total_solar_wh = 0
-    total_ev_wh = 0
-    wh_from_solar = 0
-    wh_from_grid = 0
-    number_of_charges = 0
-    min_time_charging = 0
-    max_time_charging = 0
-    total_time_charging = 0
 
     print("Testing dataset: " + dataset)
 
-    # Read in the dataset and pass to the divert_sim process
-    with open(path.join('data', dataset+'.csv'), 'r', encoding="utf-8") as input_data:
-        with open(path.join('output', output+'.csv'), 'w', encoding="utf-8") as output_data:
-            # open the divert_sim process
-            command = ["./divert_sim"]
-            if config:
-                command.append("-c")
-                command.append(config)
-            if grid_ie_col:
-                command.append("-g")
-                command.append(str(grid_ie_col))
-            if solar_col:
-                command.append("-s")
-                command.append(str(solar_col))
-            if voltage_col:
-                command.append("-v")
-                command.append(str(voltage_col))
-            if separator:
-                command.append("--sep")
-                command.append(separator)
-            if is_kw:
-                command.append("--kw")
-
-            divert_process = Popen(command, stdin=input_data, stdout=PIPE,
-                    stderr=PIPE, universal_newlines=True)
-            while True:
-                output = divert_process.stdout.readline()
-                if output == '' and divert_process.poll() is not None:
-                    break
-                if output:
-                    output_data.write(output)
-                    line_number += 1
-                    if line_number > 1:
-                        # read in the csv line
-                        csv_line = output.split(',')
-                        date = datetime.strptime(csv_line[0], '%d/%m/%Y %H:%M:%S')
-                        solar = float(csv_line[1])
-                        # grid_ie = float(csv_line[2])
-                        # pilot = int(csv_line[3])
-                        charge_power = float(csv_line[4])
-                        # min_charge_power = float(csv_line[5])
-                        state = int(csv_line[6])
-                        # smoothed_available = float(csv_line[7])
-
-                        if last_date is not None:
-                            # Get the difference between this date and last date
-                            diff = date - last_date
-
-                            hours = diff.seconds / 3600
-
-                            total_solar_wh += solar * hours
-                            ev_wh = charge_power * hours
-                            total_ev_wh += charge_power * hours
-                            charge_from_solar_wh = min(solar, charge_power) * hours
-                            wh_from_solar += charge_from_solar_wh
-                            wh_from_grid += ev_wh - charge_from_solar_wh
-
-                            if state == OPENEVSE_STATE_CHARGING and last_state != OPENEVSE_STATE_CHARGING:
-                                number_of_charges += 1
-                                charge_start_date = date
-
-                            if state != OPENEVSE_STATE_CHARGING and last_state == OPENEVSE_STATE_CHARGING:
-                                this_session_time_charging = (date - charge_start_date).seconds
-                                total_time_charging += this_session_time_charging
-                                if min_time_charging == 0 or this_session_time_charging < min_time_charging:
-                                    min_time_charging = this_session_time_charging
-                                if this_session_time_charging > max_time_charging:
-                                    max_time_charging = this_session_time_charging
-
-                        last_date = date
-                        last_state = state
-
-        solar_kwh=total_solar_wh / 1000
-        ev_kwh=total_ev_wh / 1000
-        kwh_from_solar=wh_from_solar / 1000
-        kwh_from_grid=wh_from_grid / 1000
-
-        if config is False or config.startswith('{'):
-            config = "Default"
-
-        with open(path.join('output', summary_filename), 'a', encoding="utf-8") as summary_file:
-            summary_file.write(f'"{dataset}","{config}",{solar_kwh},{ev_kwh},{kwh_from_solar},{kwh_from_grid},{number_of_charges},{min_time_charging},{max_time_charging},{total_time_charging}\n')
-
+    # divert_sim writes the per sample CSV itself and reports the summary on stdout
+    command = ["./divert_sim",
+               "-i", path.join('data', dataset+'.csv'),
+               "-o", path.join('output', output+'.csv'),
+               "--summary-json"]
+    if config:
+        command.append("-c")
+        command.append(config)
+    if grid_ie_col:
+        command.append("-g")
+        command.append(str(grid_ie_col))
+    if solar_col:
+        command.append("-s")
+        command.append(str(solar_col))
+    if voltage_col:
+        command.append("-v")
+        command.append(str(voltage_col))
+    if separator:
+        command.append("--sep")
+        command.append(separator)
+    if is_kw:
+        command.append("--kw")
+
+    divert_process = Popen(command, stdout=PIPE, stderr=PIPE, universal_newlines=True)
+    summary = json.loads(divert_process.communicate()[0])
+
+    solar_kwh = summary['solar_kwh']
+    ev_kwh = summary['ev_kwh']
+    kwh_from_solar = summary['kwh_from_solar']
+    kwh_from_grid = summary['kwh_from_grid']
+    number_of_charges = summary['number_of_charges']
+    min_time_charging = summary['min_time_charging']
+    max_time_charging = summary['max_time_charging']
+    total_time_charging = summary['total_time_charging']
+
+    if config is False or config.startswith('{'):
+        config = "Default"
+
+    with open(path.join('output', summary_filename), 'a', encoding="utf-8") as summary_file:
+        summary_file.write(f'"{dataset}","{config}",{solar_kwh},{ev_kwh},{kwh_from_solar},{kwh_from_grid},{number_of_charges},{min_time_charging},{max_time_charging},{total_time_charging}\n')
 
     return (round(solar_kwh, KWH_ROUNDING),
             round(ev_kwh, KWH_ROUNDING),
@@ -151,3 +95,55 @@ def run_simulation(dataset: str,
             min_time_charging,
             max_time_charging,
             total_time_charging)
+
+def run_sweep(dataset: str,
+              sweep,
+              jobs: int = 0, grid_ie_col: bool = False,
+              solar_col: bool = False, voltage_col: bool = False,
+              separator: str = ',', is_kw: bool = False) -> list:
+    """Run every config in the sweep against the dataset in a single divert_sim process"""
+
+    print("Sweeping dataset: " + dataset)
+
+    command = ["./divert_sim", "--sweep", sweep if isinstance(sweep, str) else json.dumps(sweep)]
+    if jobs:
+        command.append("-j")
+        command.append(str(jobs))
+    if grid_ie_col:
+        command.append("-g")
+        command.append(str(grid_ie_col))
+    if solar_col:
+        command.append("-s")
+        command.append(str(solar_col))
+    if voltage_col:
+        command.append("-v")
+        command.append(str(voltage_col))
+    if separator:
+        command.append("--sep")
+        command.append(separator)
+    if is_kw:
+        command.append("--kw")
+
+    with open(path.join('data', dataset+'.csv'), 'r', encoding="utf-8") as input_data:
+        divert_process = Popen(command, stdin=input_data, stdout=PIPE,
+                stderr=PIPE, universal_newlines=True)
+        output = divert_process.communicate()[0]
+
+    results = []
+    for row in list(csv.reader(output.splitlines()))[1:]:
+        results.append((row[0],
+                        round(float(row[1]), KWH_ROUNDING),
+                        round(float(row[2]), KWH_ROUNDING),
+                        round(float(row[3]), KWH_ROUNDING),
+                        round(float(row[4]), KWH_ROUNDING),
+                        int(row[5]),
+                        int(row[6]),
+                        int(row[7]),
+                        int(row[8])))
+
+    with open(path.join('output', summary_filename), 'a', encoding="utf-8") as summary_file:
+        for (config, *summary) in results:
+            config = config.replace('"', '""')
+            summary_file.write(f'"{dataset}","{config}",' + ','.join(str(value) for value in summary) + '\n')
+
+    return results
@@ -0,0 +1,76 @@
+#include <Arduino.h>
+#include <MicroTasks.h>
+#include <epoxy_test/ArduinoTest.h>
+
+#include <vector>
+
+#include "sim_clock.h"
+#include "task_clock.h"
+
+SimulationClock simClock;
+
+unsigned long task_clock_schedule(const void *task, unsigned long delay)
+{
+  simClock.schedule(task, delay);
+  return delay;
+}
+
+SimulationClock::SimulationClock() :
+  _wakeup_count(0)
+{
+}
+
+void SimulationClock::schedule(const void *task, unsigned long delay)
+{
+  if(MicroTask.Infinate == delay) {
+    _due.erase(task);
+  } else {
+    _due[task] = millis() + delay;
+  }
+}
+
+void SimulationClock::advanceTo(unsigned long until, std::function<void()> wakeup)
+{
+  while(_due.size() > 0)
+  {
+    unsigned long next = _due.begin()->second;
+    for(auto &due : _due) {
+      if(due.second < next) {
+        next = due.second;
+      }
+    }
+
+    if(next > until) {
+      break;
+    }
+
+    if(next > millis()) {
+      EpoxyTest::add_millis(next - millis());
+    }
+
+    // Tasks due at the same time are all run by the one update, and list
+    // themselves again from loop()
+    std::vector<const void *> running;
+    for(auto &due : _due) {
+      if(due.second <= next) {
+        running.push_back(due.first);
+      }
+    }
+
+    wakeup();
+    _wakeup_count++;
+
+    // A task that did not run is retried a ms later rather than stalling the clock
+    for(const void *task : running)
+    {
+      auto due = _due.find(task);
+      if(due != _due.end() && due->second <= next) {
+        due->second = next + 1;
+      }
+    }
+  }
+
+  if(until > millis()) {
+    EpoxyTest::add_millis(until - millis());
+  }
+}
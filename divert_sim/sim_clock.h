@@ -0,0 +1,37 @@
+#ifndef _DIVERT_SIM_CLOCK_H
+#define _DIVERT_SIM_CLOCK_H
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+
+// Discrete event clock for the simulation. Rather than jumping straight from one
+// sample to the next, time is advanced to each time a task asked to run again,
+// as returned by its loop() (see task_clock.h), so every task runs when it would
+// on the device, and any time with nothing scheduled is skipped over.
+class SimulationClock
+{
+  private:
+    // When each task is next due (ms), tasks waiting for an event are not listed
+    std::map<const void *, unsigned long> _due;
+    uint32_t _wakeup_count;
+
+  public:
+    SimulationClock();
+
+    // Record the delay a task returned from loop()
+    void schedule(const void *task, unsigned long delay);
+
+    // Advance to `until` (ms), calling wakeup at each scheduled wake time on the way
+    void advanceTo(unsigned long until, std::function<void()> wakeup);
+
+    // Number of wakeups run so far
+    uint32_t getWakeupCount() {
+      return _wakeup_count;
+    }
+};
+
+// The tasks of every simulated charger report to the one clock
+extern SimulationClock simClock;
+
+#endif // _DIVERT_SIM_CLOCK_H
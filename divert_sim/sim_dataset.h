@@ -0,0 +1,61 @@
+#ifndef _DIVERT_SIM_DATASET_H
+#define _DIVERT_SIM_DATASET_H
+
+#include <stddef.h>
+#include <time.h>
+#include <vector>
+
+// A single row of the input dataset
+struct SimulationSample
+{
+  time_t time;
+  int solar;
+  int grid_ie;
+  int live_pwr;
+  double voltage;
+};
+
+typedef std::vector<SimulationSample> SimulationDataset;
+
+// Supplies the samples for a run, either from a loaded dataset or generated on the fly
+class SampleSource
+{
+  public:
+    virtual ~SampleSource() {
+    }
+
+    // Go back to the first sample, each run replays the whole source
+    virtual void rewind() = 0;
+
+    // Get the next sample, returns false at the end of the source
+    virtual bool next(SimulationSample &sample) = 0;
+};
+
+class DatasetSource : public SampleSource
+{
+  private:
+    const SimulationDataset &_dataset;
+    size_t _index;
+
+  public:
+    DatasetSource(const SimulationDataset &dataset) :
+      _dataset(dataset),
+      _index(0)
+    {
+    }
+
+    void rewind() {
+      _index = 0;
+    }
+
+    bool next(SimulationSample &sample)
+    {
+      if(_index >= _dataset.size()) {
+        return false;
+      }
+      sample = _dataset[_index++];
+      return true;
+    }
+};
+
+#endif // _DIVERT_SIM_DATASET_H
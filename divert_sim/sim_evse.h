@@ -0,0 +1,18 @@
+#ifndef _DIVERT_SIM_EVSE_H
+#define _DIVERT_SIM_EVSE_H
+
+#include <Arduino.h>
+
+// State of a simulated OpenEVSE controller, as reported through the fake RAPI
+// interface. Ports without an attached EVSE use the pilot/state/amps globals.
+struct SimulatedEvse
+{
+  long pilot;
+  long state;
+  double amps;
+};
+
+void sim_evse_attach(Stream *port, SimulatedEvse *evse);
+void sim_evse_detach(Stream *port);
+
+#endif // _DIVERT_SIM_EVSE_H
@@ -0,0 +1,188 @@
+#include <math.h>
+#include <ArduinoJson.h>
+
+#include "sim_generator.h"
+
+#define DEG_TO_RADIANS (M_PI / 180.0)
+
+SyntheticDataset::SyntheticDataset() :
+  _seed(1),
+  _start(1590969600), // 2020-06-01T00:00:00Z
+  _days(1),
+  _interval(10),
+  _latitude(51.5),
+  _peak_solar(4000),
+  _cloudiness(0.3),
+  _cloud_time(600),
+  _base_load(300),
+  _peak_load(1500),
+  _appliances(0.5),
+  _voltage(240),
+  _voltage_variation(5)
+{
+  rewind();
+}
+
+bool SyntheticDataset::deserialize(const char *json)
+{
+  StaticJsonDocument<1024> doc;
+  DeserializationError error = deserializeJson(doc, json);
+  if(error || !doc.is<JsonObject>()) {
+    return false;
+  }
+
+  _seed = doc["seed"] | _seed;
+  _start = doc["start"] | (long long)_start;
+  _days = doc["days"] | _days;
+  _interval = doc["interval"] | _interval;
+  _latitude = doc["latitude"] | _latitude;
+  _peak_solar = doc["peak_solar"] | _peak_solar;
+  _cloudiness = doc["cloudiness"] | _cloudiness;
+  _cloud_time = doc["cloud_time"] | _cloud_time;
+  _base_load = doc["base_load"] | _base_load;
+  _peak_load = doc["peak_load"] | _peak_load;
+  _appliances = doc["appliances"] | _appliances;
+  _voltage = doc["voltage"] | _voltage;
+  _voltage_variation = doc["voltage_variation"] | _voltage_variation;
+
+  if(0 == _interval || _cloudiness < 0 || _cloudiness > 1 || _cloud_time <= 0) {
+    return false;
+  }
+
+  rewind();
+  return true;
+}
+
+void SyntheticDataset::rewind()
+{
+  _random = _seed;
+  _time = _start;
+  _end = _start + (time_t)_days * 86400;
+  _cloudy = false;
+  _cloud_target = 1;
+  _cloud = 1;
+  _appliance_pwr = 0;
+  _appliance_end = 0;
+}
+
+// splitmix64, small and gives the same sequence on every platform unlike <random>
+double SyntheticDataset::random()
+{
+  uint64_t z = (_random += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Approximately normal, mean 0 and standard deviation 1
+double SyntheticDataset::gaussian()
+{
+  double sum = 0;
+  for(int i = 0; i < 12; i++) {
+    sum += random();
+  }
+  return sum - 6;
+}
+
+// Clear sky PV output, treating the timestamps as local solar time
+double SyntheticDataset::clearSky(const struct tm &tm)
+{
+  double hours = tm.tm_hour + tm.tm_min / 60.0 + tm.tm_sec / 3600.0;
+  double declination = 23.44 * DEG_TO_RADIANS * sin(2 * M_PI * (284 + tm.tm_yday) / 365.0);
+  double hour_angle = (hours - 12) * 15 * DEG_TO_RADIANS;
+  double latitude = _latitude * DEG_TO_RADIANS;
+
+  double sin_elevation = sin(latitude) * sin(declination) +
+                         cos(latitude) * cos(declination) * cos(hour_angle);
+  if(sin_elevation <= 0) {
+    return 0;
+  }
+
+  // Meinel air mass attenuation, normalised to the peak with the sun overhead
+  double air_mass = 1 / sin_elevation;
+  return _peak_solar * sin_elevation * pow(0.7, pow(air_mass, 0.678) - 1);
+}
+
+double SyntheticDataset::houseLoad(const struct tm &tm)
+{
+  double hours = tm.tm_hour + tm.tm_min / 60.0;
+  double morning = (hours - 7.5) / 1.0;
+  double evening = (hours - 18.5) / 1.5;
+
+  double load = _base_load * (1 + 0.05 * gaussian()) +
+                _peak_load * (0.6 * exp(-morning * morning) + exp(-evening * evening));
+
+  // Kettles, ovens, washing machines etc
+  if(_time >= _appliance_end)
+  {
+    _appliance_pwr = 0;
+    if(random() < (_appliances * _interval) / 3600) {
+      _appliance_pwr = 1000 + 2000 * random();
+      _appliance_end = _time + 60 + (time_t)(1740 * random());
+    }
+  }
+
+  load += _appliance_pwr;
+  return load > 0 ? load : 0;
+}
+
+void SyntheticDataset::updateClouds()
+{
+  if(_cloudiness > 0 && _cloudiness < 1)
+  {
+    double clear_time = _cloud_time * (1 - _cloudiness) / _cloudiness;
+    if(random() < _interval / (_cloudy ? _cloud_time : clear_time))
+    {
+      _cloudy = !_cloudy;
+      _cloud_target = _cloudy ? 0.1 + 0.4 * random() : 1;
+    }
+  } else {
+    _cloudy = _cloudiness >= 1;
+    _cloud_target = _cloudy ? 0.3 : 1;
+  }
+
+  // Cloud edges take a little while to pass, and the cover flickers while cloudy
+  double target = _cloud_target;
+  if(_cloudy) {
+    target += 0.05 * gaussian();
+  }
+  double rate = _interval / 30.0;
+  _cloud += (target - _cloud) * (rate < 1 ? rate : 1);
+  if(_cloud < 0) {
+    _cloud = 0;
+  } else if(_cloud > 1) {
+    _cloud = 1;
+  }
+}
+
+bool SyntheticDataset::next(SimulationSample &sample)
+{
+  if(_time >= _end) {
+    return false;
+  }
+
+  struct tm tm;
+  gmtime_r(&_time, &tm);
+
+  updateClouds();
+  double solar = clearSky(tm) * _cloud;
+  double load = houseLoad(tm);
+
+  double hours = tm.tm_hour + tm.tm_min / 60.0;
+  double voltage = _voltage +
+                   0.5 * _voltage_variation * sin(2 * M_PI * (hours - 3) / 24) +
+                   0.1 * _voltage_variation * gaussian();
+  if(solar > load) {
+    voltage += (solar - load) / 1000;
+  }
+
+  sample.time = _time;
+  sample.solar = (int)round(solar);
+  sample.live_pwr = (int)round(load);
+  sample.grid_ie = sample.live_pwr - sample.solar;
+  sample.voltage = round(voltage);
+
+  _time += _interval;
+  return true;
+}
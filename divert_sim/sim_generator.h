@@ -0,0 +1,61 @@
+#ifndef _DIVERT_SIM_GENERATOR_H
+#define _DIVERT_SIM_GENERATOR_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sim_dataset.h"
+
+// Deterministic synthetic dataset, generated a sample at a time so arbitrarily long
+// runs need no input file or memory for the samples. Solar is a clear sky model with
+// Markov cloud transients, the house load is a base load with morning and evening
+// peaks plus random appliance events, and the voltage drifts and rises with export.
+// The same seed always gives the same samples.
+class SyntheticDataset : public SampleSource
+{
+  private:
+    // Options
+    uint64_t _seed;
+    time_t _start;
+    uint32_t _days;
+    uint32_t _interval;           // s
+    double _latitude;             // degrees
+    double _peak_solar;           // W
+    double _cloudiness;           // fraction of the time under cloud
+    double _cloud_time;           // mean length of a cloud, s
+    double _base_load;            // W
+    double _peak_load;            // W
+    double _appliances;           // appliance events per hour
+    double _voltage;              // V
+    double _voltage_variation;    // V
+
+    // Generator state
+    uint64_t _random;
+    time_t _time;
+    time_t _end;
+    bool _cloudy;
+    double _cloud_target;
+    double _cloud;
+    double _appliance_pwr;
+    time_t _appliance_end;
+
+    double random();
+    double gaussian();
+    double clearSky(const struct tm &tm);
+    double houseLoad(const struct tm &tm);
+    void updateClouds();
+
+  public:
+    SyntheticDataset();
+
+    // Load the options from JSON, missing options keep their defaults
+    //   seed, start (epoch), days, interval (s), latitude, peak_solar (W), cloudiness (0-1),
+    //   cloud_time (s), base_load (W), peak_load (W), appliances (per hour), voltage,
+    //   voltage_variation
+    bool deserialize(const char *json);
+
+    void rewind();
+    bool next(SimulationSample &sample);
+};
+
+#endif // _DIVERT_SIM_GENERATOR_H
@@ -0,0 +1,273 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sim_input.h"
+
+MappedFile::MappedFile() :
+  _data(NULL),
+  _size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(int fd)
+{
+  close();
+
+  struct stat st;
+  if(0 != fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+
+  if(0 == st.st_size) {
+    return true;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(MAP_FAILED == data) {
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  _data = (const char *)data;
+  _size = st.st_size;
+  return true;
+}
+
+bool MappedFile::open(const char *path)
+{
+  int fd = ::open(path, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  bool success = open(fd);
+  ::close(fd);
+  return success;
+}
+
+void MappedFile::close()
+{
+  if(_data) {
+    munmap((void *)_data, _size);
+  }
+  _data = NULL;
+  _size = 0;
+}
+
+CsvTokenizer::CsvTokenizer(const char *start, const char *end, char delimiter) :
+  _pos(start),
+  _end(end),
+  _delimiter(delimiter)
+{
+}
+
+int CsvTokenizer::nextRow(CsvField *fields, int max_fields)
+{
+  if(_pos >= _end) {
+    return -1;
+  }
+
+  int count = 0;
+  const char *pos = _pos;
+  while(true)
+  {
+    const char *start = pos;
+    const char *end;
+
+    if(pos < _end && '"' == *pos)
+    {
+      // Quoted field, runs to the next quote that is not doubled up
+      start = ++pos;
+      while(pos < _end && ('"' != *pos || (pos + 1 < _end && '"' == pos[1]))) {
+        pos += '"' == *pos ? 2 : 1;
+      }
+      end = pos;
+      // Skip the closing quote and anything up to the delimiter
+      while(pos < _end && _delimiter != *pos && '\n' != *pos && '\r' != *pos) {
+        pos++;
+      }
+    }
+    else
+    {
+      while(pos < _end && _delimiter != *pos && '\n' != *pos && '\r' != *pos) {
+        pos++;
+      }
+      end = pos;
+    }
+
+    if(count < max_fields) {
+      fields[count].start = start;
+      fields[count].end = end;
+      count++;
+    }
+
+    if(pos < _end && _delimiter == *pos) {
+      pos++;
+      continue;
+    }
+
+    // End of the row, treat \r\n as a single line ending
+    if(pos < _end && '\r' == *pos) {
+      pos++;
+    }
+    if(pos < _end && '\n' == *pos) {
+      pos++;
+    }
+    break;
+  }
+
+  _pos = pos;
+  return count;
+}
+
+static const char *skip_space(const char *pos, const char *end)
+{
+  while(pos < end && (' ' == *pos || '\t' == *pos)) {
+    pos++;
+  }
+  return pos;
+}
+
+// Read an unsigned decimal number, returns NULL if there are no digits
+static const char *read_number(const char *pos, const char *end, long &value)
+{
+  const char *start = pos;
+  long number = 0;
+  while(pos < end && (unsigned)(*pos - '0') < 10) {
+    number = number * 10 + (*pos - '0');
+    pos++;
+  }
+  value = number;
+  return pos > start ? pos : NULL;
+}
+
+static const char *expect(const char *pos, const char *end, char c)
+{
+  return (pos && pos < end && c == *pos) ? pos + 1 : NULL;
+}
+
+// Days since 1970-01-01 for a date in the proleptic Gregorian calendar
+static long days_from_civil(long y, long m, long d)
+{
+  y -= m <= 2;
+  const long era = (y >= 0 ? y : y - 399) / 400;
+  const long yoe = y - era * 400;
+  const long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static time_t make_time(long y, long M, long d, long h, long m, long s)
+{
+  return (time_t)days_from_civil(y, M, d) * 86400 + h * 3600 + m * 60 + s;
+}
+
+DateParser::DateParser() :
+  _format(Unknown)
+{
+}
+
+bool DateParser::parseDateTime(const char *start, const char *end, time_t &time)
+{
+  long y, M, d, h, m, s;
+  const char *pos = read_number(skip_space(start, end), end, y);
+  pos = expect(pos, end, '-');
+  pos = pos ? read_number(pos, end, M) : NULL;
+  pos = expect(pos, end, '-');
+  pos = pos ? read_number(pos, end, d) : NULL;
+  if(NULL == pos || pos >= end || ('T' != *pos && ' ' != *pos)) {
+    return false;
+  }
+  pos = read_number(skip_space(pos + 1, end), end, h);
+  pos = expect(pos, end, ':');
+  pos = pos ? read_number(pos, end, m) : NULL;
+  pos = expect(pos, end, ':');
+  pos = pos ? read_number(pos, end, s) : NULL;
+  if(NULL == pos) {
+    return false;
+  }
+
+  // Any timezone suffix is ignored, the datasets are all UTC
+  time = make_time(y, M, d, h, m, s);
+  return true;
+}
+
+bool DateParser::parseTimeOfDay(const char *start, const char *end, time_t &time)
+{
+  long h, m;
+  const char *pos = read_number(skip_space(start, end), end, h);
+  pos = expect(pos, end, ':');
+  pos = pos ? read_number(pos, end, m) : NULL;
+  if(NULL == pos) {
+    return false;
+  }
+  pos = skip_space(pos, end);
+  if(pos >= end) {
+    return false;
+  }
+
+  if(12 == h) {
+    h -= 12;
+  }
+  if('P' == *pos) {
+    h += 12;
+  }
+
+  time = make_time(2020, 1, 1, h, m, 0);
+  return true;
+}
+
+bool DateParser::parseEpoch(const char *start, const char *end, time_t &time)
+{
+  long s;
+  const char *pos = skip_space(start, end);
+  bool negative = pos < end && '-' == *pos;
+  pos = read_number(negative ? pos + 1 : pos, end, s);
+  if(NULL == pos || (pos < end && ('-' == *pos || ':' == *pos))) {
+    return false;
+  }
+
+  time = negative ? -s : s;
+  return true;
+}
+
+bool DateParser::parseFormat(Format format, const char *start, const char *end, time_t &time)
+{
+  switch(format)
+  {
+    case DateTime:
+      return parseDateTime(start, end, time);
+    case TimeOfDay:
+      return parseTimeOfDay(start, end, time);
+    case Epoch:
+      return parseEpoch(start, end, time);
+    default:
+      return false;
+  }
+}
+
+bool DateParser::parse(const char *start, const char *end, time_t &time)
+{
+  if(parseFormat(_format, start, end, time)) {
+    return true;
+  }
+
+  static const Format formats[] = { DateTime, TimeOfDay, Epoch };
+  for(Format format : formats)
+  {
+    if(format != _format && parseFormat(format, start, end, time)) {
+      _format = format;
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,95 @@
+#ifndef _DIVERT_SIM_INPUT_H
+#define _DIVERT_SIM_INPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifndef CSV_MAX_FIELDS
+#define CSV_MAX_FIELDS 16
+#endif
+
+// Read only memory map of an input file, avoids copying the dataset through a stream
+class MappedFile
+{
+  private:
+    const char *_data;
+    size_t _size;
+
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    // Map an open file descriptor, fails if the descriptor is not a regular file (eg a pipe)
+    bool open(int fd);
+    bool open(const char *path);
+    void close();
+
+    const char *begin() {
+      return _data;
+    }
+
+    const char *end() {
+      return _data + _size;
+    }
+
+    size_t size() {
+      return _size;
+    }
+};
+
+// A field of a CSV row, points directly into the mapped data
+struct CsvField
+{
+  const char *start;
+  const char *end;
+};
+
+// Splits a buffer into rows and fields without copying. Quoted fields have the
+// quotes removed, escaped quotes within a field are left as is.
+class CsvTokenizer
+{
+  private:
+    const char *_pos;
+    const char *_end;
+    char _delimiter;
+
+  public:
+    CsvTokenizer(const char *start, const char *end, char delimiter);
+
+    // Read the next row into fields, returns the number of fields or -1 at the end of the input
+    int nextRow(CsvField *fields, int max_fields = CSV_MAX_FIELDS);
+};
+
+// Parses the timestamps used by the datasets, the format is detected from the first
+// timestamp that parses and then used for the rest of the file, only re-detecting
+// if a later timestamp does not match.
+class DateParser
+{
+  public:
+    enum Format : uint8_t {
+      Unknown,
+      DateTime,   // 2020-03-16T06:40:00Z, 2020-03-16T06:40:00+00:00 or 2020-03-16 06:40:00
+      TimeOfDay,  // 12:15 AM, the date is assumed to be 2020-01-01
+      Epoch       // 1533530700
+    };
+
+  private:
+    Format _format;
+
+    static bool parseDateTime(const char *start, const char *end, time_t &time);
+    static bool parseTimeOfDay(const char *start, const char *end, time_t &time);
+    static bool parseEpoch(const char *start, const char *end, time_t &time);
+    static bool parseFormat(Format format, const char *start, const char *end, time_t &time);
+
+  public:
+    DateParser();
+
+    bool parse(const char *start, const char *end, time_t &time);
+
+    Format getFormat() {
+      return _format;
+    }
+};
+
+#endif // _DIVERT_SIM_INPUT_H
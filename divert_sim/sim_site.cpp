@@ -0,0 +1,51 @@
+#include "sim_site.h"
+
+SimulatedCharger::SimulatedCharger(EventLog &eventLog) :
+  _port(),
+  _rapi{ 32, OPENEVSE_STATE_CONNECTED, 0 },
+  _openevse(),
+  _evse(_port, eventLog, _openevse),
+  _divert(_evse),
+  _vehicle(),
+  _use_vehicle(false),
+  _summary()
+{
+  sim_evse_attach(&_port, &_rapi);
+}
+
+SimulatedCharger::~SimulatedCharger()
+{
+  sim_evse_detach(&_port);
+}
+
+bool SimulatedCharger::setVehicle(const char *json)
+{
+  _use_vehicle = _vehicle.deserialize(json);
+  return _use_vehicle;
+}
+
+void SimulatedCharger::begin()
+{
+  _evse.begin();
+  _divert.begin();
+}
+
+void SimulatedCharger::charge(double voltage, double seconds)
+{
+  if(_use_vehicle) {
+    _vehicle.charge(_rapi.amps, voltage, seconds);
+  }
+}
+
+double SimulatedCharger::updateLoad(double voltage)
+{
+  if(_use_vehicle)
+  {
+    _rapi.amps = _vehicle.getCurrent(getPilot(), voltage);
+    _evse.setVehicleStateOfCharge((int)_vehicle.getSoc());
+    return _vehicle.getPower(_rapi.amps, voltage);
+  }
+
+  _rapi.amps = getPilot();
+  return _rapi.amps * voltage;
+}
@@ -0,0 +1,67 @@
+#ifndef _DIVERT_SIM_SITE_H
+#define _DIVERT_SIM_SITE_H
+
+#include <Arduino.h>
+#include <StdioSerial.h>
+#include <openevse.h>
+
+#include "evse_man.h"
+#include "divert.h"
+#include "sim_evse.h"
+#include "sim_vehicle.h"
+#include "sim_summary.h"
+
+// One of several chargers sharing a grid connection. Each charger has its own
+// OpenEVSE controller, EVSE manager and divert loop, and only sees the grid meter,
+// which includes the load of all the other chargers on the site.
+class SimulatedCharger
+{
+  private:
+    StdioSerial _port;
+    SimulatedEvse _rapi;
+    OpenEVSEClass _openevse;
+    EvseManager _evse;
+    DivertTask _divert;
+    VehicleModel _vehicle;
+    bool _use_vehicle;
+    SimulationSummary _summary;
+
+  public:
+    SimulatedCharger(EventLog &eventLog);
+    ~SimulatedCharger();
+
+    // Use a vehicle model rather than drawing the full pilot, see VehicleModel
+    bool setVehicle(const char *json);
+
+    void begin();
+    bool isConnected() {
+      return _evse.isConnected();
+    }
+    void setMode(DivertMode mode) {
+      _divert.setMode(mode);
+    }
+
+    // Integrate the vehicle charge over the time since the last sample
+    void charge(double voltage, double seconds);
+
+    // Update the current the vehicle is drawing, returns the power (W)
+    double updateLoad(double voltage);
+
+    void updateDivert() {
+      _divert.update_state(millis());
+    }
+
+    long getPilot() {
+      return OPENEVSE_STATE_CHARGING == _rapi.state ? _rapi.pilot : 0;
+    }
+
+    long getState() {
+      return _rapi.state;
+    }
+
+    SimulationSummary &getSummary() {
+      return _summary;
+    }
+};
+
+#endif // _DIVERT_SIM_SITE_H
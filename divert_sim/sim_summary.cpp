@@ -0,0 +1,191 @@
+#include <iomanip>
+
+#include "openevse.h"
+#include "sim_summary.h"
+
+// Seconds between two samples, wrapped to a day to match the Python timedelta.seconds
+// the summaries were originally calculated with
+static uint32_t elapsed_seconds(time_t from, time_t to)
+{
+  long diff = (long)(to - from) % 86400;
+  return diff < 0 ? diff + 86400 : diff;
+}
+
+SimulationSummary::SimulationSummary()
+{
+  reset();
+}
+
+void SimulationSummary::reset()
+{
+  _has_last = false;
+  _last_time = 0;
+  _last_state = 0;
+  _charge_start = 0;
+
+  _total_solar_wh = 0;
+  _total_ev_wh = 0;
+  _wh_from_solar = 0;
+  _wh_from_grid = 0;
+  _number_of_charges = 0;
+  _min_time_charging = 0;
+  _max_time_charging = 0;
+  _total_time_charging = 0;
+  _relay_switches = 0;
+}
+
+void SimulationSummary::update(time_t time, int solar, int charge_power, long state)
+{
+  if(_has_last)
+  {
+    double hours = (double)elapsed_seconds(_last_time, time) / 3600;
+
+    _total_solar_wh += solar * hours;
+    double ev_wh = charge_power * hours;
+    _total_ev_wh += ev_wh;
+    double charge_from_solar_wh = (solar < charge_power ? solar : charge_power) * hours;
+    _wh_from_solar += charge_from_solar_wh;
+    _wh_from_grid += ev_wh - charge_from_solar_wh;
+
+    if(OPENEVSE_STATE_CHARGING == state && OPENEVSE_STATE_CHARGING != _last_state)
+    {
+      _number_of_charges++;
+      _charge_start = time;
+    }
+
+    if(OPENEVSE_STATE_CHARGING != state && OPENEVSE_STATE_CHARGING == _last_state)
+    {
+      uint32_t session_time = elapsed_seconds(_charge_start, time);
+      _total_time_charging += session_time;
+      if(0 == _min_time_charging || session_time < _min_time_charging) {
+        _min_time_charging = session_time;
+      }
+      if(session_time > _max_time_charging) {
+        _max_time_charging = session_time;
+      }
+    }
+  }
+  else
+  {
+    _charge_start = time;
+  }
+
+  _has_last = true;
+  _last_time = time;
+  _last_state = state;
+}
+
+void SimulationSummary::printCsvHeader(std::ostream &out)
+{
+  out << "\"Total Solar (kWh)\",\"Total EV Charge (kWh)\",\"Charge from solar (kWh)\",\"Charge from grid (kWh)\","
+         "\"Number of charges\",\"Min time charging\",\"Max time charging\",\"Total time charging\",\"Relay switches\"";
+}
+
+void SimulationSummary::printCsv(std::ostream &out)
+{
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision(12);
+
+  out << getSolarKwh() << ","
+      << getEvKwh() << ","
+      << getKwhFromSolar() << ","
+      << getKwhFromGrid() << ","
+      << _number_of_charges << ","
+      << _min_time_charging << ","
+      << _max_time_charging << ","
+      << _total_time_charging << ","
+      << _relay_switches;
+
+  out.precision(precision);
+  out.flags(flags);
+}
+
+void SimulationSummary::serialize(JsonDocument &doc)
+{
+  doc["solar_kwh"] = getSolarKwh();
+  doc["ev_kwh"] = getEvKwh();
+  doc["kwh_from_solar"] = getKwhFromSolar();
+  doc["kwh_from_grid"] = getKwhFromGrid();
+  doc["number_of_charges"] = _number_of_charges;
+  doc["min_time_charging"] = _min_time_charging;
+  doc["max_time_charging"] = _max_time_charging;
+  doc["total_time_charging"] = _total_time_charging;
+  doc["relay_switches"] = _relay_switches;
+}
+
+ShaperSummary::ShaperSummary()
+{
+  reset();
+}
+
+void ShaperSummary::reset()
+{
+  _has_last = false;
+  _last_time = 0;
+  _last_paused = false;
+  _last_over = false;
+
+  _pauses = 0;
+  _seconds_paused = 0;
+  _violations = 0;
+  _seconds_over_budget = 0;
+  _max_overshoot = 0;
+}
+
+void ShaperSummary::update(time_t time, int site_pwr, int max_pwr, bool paused)
+{
+  bool over = site_pwr > max_pwr;
+
+  if(_has_last && time > _last_time)
+  {
+    uint32_t seconds = time - _last_time;
+    if(_last_paused) {
+      _seconds_paused += seconds;
+    }
+    if(_last_over) {
+      _seconds_over_budget += seconds;
+    }
+  }
+
+  if(paused && !_last_paused) {
+    _pauses++;
+  }
+
+  if(over)
+  {
+    if(!_last_over) {
+      _violations++;
+    }
+    if(site_pwr - max_pwr > _max_overshoot) {
+      _max_overshoot = site_pwr - max_pwr;
+    }
+  }
+
+  _has_last = true;
+  _last_time = time;
+  _last_paused = paused;
+  _last_over = over;
+}
+
+void ShaperSummary::printCsvHeader(std::ostream &out)
+{
+  out << "\"Shaper pauses\",\"Time paused\",\"Budget violations\",\"Time over budget\",\"Max overshoot (W)\"";
+}
+
+void ShaperSummary::printCsv(std::ostream &out)
+{
+  out << _pauses << ","
+      << _seconds_paused << ","
+      << _violations << ","
+      << _seconds_over_budget << ","
+      << _max_overshoot;
+}
+
+void ShaperSummary::serialize(JsonDocument &doc)
+{
+  doc["shaper_pauses"] = _pauses;
+  doc["shaper_time_paused"] = _seconds_paused;
+  doc["shaper_violations"] = _violations;
+  doc["shaper_time_over_budget"] = _seconds_over_budget;
+  doc["shaper_max_overshoot"] = _max_overshoot;
+}
@@ -0,0 +1,131 @@
+#ifndef _DIVERT_SIM_SUMMARY_H
+#define _DIVERT_SIM_SUMMARY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <ostream>
+#include <ArduinoJson.h>
+
+// Accumulates the per run totals that used to be calculated by run_simulations.py
+// from the CSV output, so a run can report its summary without a second pass
+class SimulationSummary
+{
+  private:
+    bool _has_last;
+    time_t _last_time;
+    long _last_state;
+    time_t _charge_start;
+
+    double _total_solar_wh;
+    double _total_ev_wh;
+    double _wh_from_solar;
+    double _wh_from_grid;
+    uint32_t _number_of_charges;
+    uint32_t _min_time_charging;
+    uint32_t _max_time_charging;
+    uint32_t _total_time_charging;
+    uint32_t _relay_switches;
+
+  public:
+    SimulationSummary();
+
+    void reset();
+
+    // Add a simulated sample, charge_power is the power the EV was drawing (W)
+    void update(time_t time, int solar, int charge_power, long state);
+
+    double getSolarKwh() {
+      return _total_solar_wh / 1000;
+    }
+
+    double getEvKwh() {
+      return _total_ev_wh / 1000;
+    }
+
+    double getKwhFromSolar() {
+      return _wh_from_solar / 1000;
+    }
+
+    double getKwhFromGrid() {
+      return _wh_from_grid / 1000;
+    }
+
+    uint32_t getNumberOfCharges() {
+      return _number_of_charges;
+    }
+
+    uint32_t getMinTimeCharging() {
+      return _min_time_charging;
+    }
+
+    uint32_t getMaxTimeCharging() {
+      return _max_time_charging;
+    }
+
+    uint32_t getTotalTimeCharging() {
+      return _total_time_charging;
+    }
+
+    // Relay/contactor switches counted by the energy meter during the run
+    void setRelaySwitches(uint32_t switches) {
+      _relay_switches = switches;
+    }
+
+    uint32_t getRelaySwitches() {
+      return _relay_switches;
+    }
+
+    static void printCsvHeader(std::ostream &out);
+    void printCsv(std::ostream &out);
+    void serialize(JsonDocument &doc);
+};
+
+// Tracks how well the current shaper kept the site within its power budget
+class ShaperSummary
+{
+  private:
+    bool _has_last;
+    time_t _last_time;
+    bool _last_paused;
+    bool _last_over;
+
+    uint32_t _pauses;
+    uint32_t _seconds_paused;
+    uint32_t _violations;
+    uint32_t _seconds_over_budget;
+    int _max_overshoot;
+
+  public:
+    ShaperSummary();
+
+    void reset();
+
+    // Add a simulated sample, site_pwr is the total site load including the EV (W)
+    void update(time_t time, int site_pwr, int max_pwr, bool paused);
+
+    uint32_t getPauses() {
+      return _pauses;
+    }
+
+    uint32_t getSecondsPaused() {
+      return _seconds_paused;
+    }
+
+    uint32_t getViolations() {
+      return _violations;
+    }
+
+    uint32_t getSecondsOverBudget() {
+      return _seconds_over_budget;
+    }
+
+    int getMaxOvershoot() {
+      return _max_overshoot;
+    }
+
+    static void printCsvHeader(std::ostream &out);
+    void printCsv(std::ostream &out);
+    void serialize(JsonDocument &doc);
+};
+
+#endif // _DIVERT_SIM_SUMMARY_H
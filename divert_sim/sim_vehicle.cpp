@@ -0,0 +1,66 @@
+#include "sim_vehicle.h"
+
+VehicleModel::VehicleModel() :
+  _capacity(VEHICLE_DEFAULT_CAPACITY * 1000),
+  _soc(VEHICLE_DEFAULT_SOC),
+  _taper_soc(VEHICLE_DEFAULT_TAPER_SOC),
+  _charger_max(VEHICLE_DEFAULT_CHARGER_MAX),
+  _max_current(VEHICLE_DEFAULT_MAX_CURRENT),
+  _phases(1)
+{
+}
+
+bool VehicleModel::deserialize(const char *json)
+{
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, json);
+  if(error || !doc.is<JsonObject>()) {
+    return false;
+  }
+
+  _capacity = (doc["capacity"] | (_capacity / 1000)) * 1000;
+  _soc = doc["soc"] | _soc;
+  _taper_soc = doc["taper_soc"] | _taper_soc;
+  _charger_max = doc["charger_max"] | _charger_max;
+  _max_current = doc["max_current"] | _max_current;
+  _phases = doc["phases"] | _phases;
+
+  if(_capacity <= 0 || _phases < 1 || _taper_soc >= 100) {
+    return false;
+  }
+
+  return true;
+}
+
+double VehicleModel::getCurrent(double pilot, double voltage)
+{
+  if(pilot <= 0 || voltage <= 0 || _soc >= 100) {
+    return 0;
+  }
+
+  double current = pilot < _max_current ? pilot : _max_current;
+
+  double charger_current = _charger_max / (voltage * _phases);
+  if(charger_current < current) {
+    current = charger_current;
+  }
+
+  if(_soc > _taper_soc)
+  {
+    double acceptance = (_max_current * (100 - _soc)) / (100 - _taper_soc);
+    if(acceptance < current) {
+      current = acceptance;
+    }
+  }
+
+  return current;
+}
+
+void VehicleModel::charge(double current, double voltage, double seconds)
+{
+  double wh = getPower(current, voltage) * seconds / 3600;
+  _soc += (wh * 100) / _capacity;
+  if(_soc > 100) {
+    _soc = 100;
+  }
+}
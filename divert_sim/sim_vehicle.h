@@ -0,0 +1,66 @@
+#ifndef _DIVERT_SIM_VEHICLE_H
+#define _DIVERT_SIM_VEHICLE_H
+
+#include <ArduinoJson.h>
+
+#ifndef VEHICLE_DEFAULT_CAPACITY
+#define VEHICLE_DEFAULT_CAPACITY 60.0     // kWh
+#endif
+
+#ifndef VEHICLE_DEFAULT_SOC
+#define VEHICLE_DEFAULT_SOC 20.0          // %
+#endif
+
+#ifndef VEHICLE_DEFAULT_TAPER_SOC
+#define VEHICLE_DEFAULT_TAPER_SOC 80.0    // %
+#endif
+
+#ifndef VEHICLE_DEFAULT_CHARGER_MAX
+#define VEHICLE_DEFAULT_CHARGER_MAX 7400.0 // W
+#endif
+
+#ifndef VEHICLE_DEFAULT_MAX_CURRENT
+#define VEHICLE_DEFAULT_MAX_CURRENT 32.0  // A per phase
+#endif
+
+// Simple model of the vehicle on the end of the cable. The battery charges at the
+// lower of the pilot, the per phase limit and the onboard charger limit until the
+// taper SoC, then the current falls linearly to zero at 100% as the battery moves
+// to constant voltage charging.
+class VehicleModel
+{
+  private:
+    double _capacity;       // Wh
+    double _soc;            // %
+    double _taper_soc;      // %
+    double _charger_max;    // W
+    double _max_current;    // A per phase
+    int _phases;
+
+  public:
+    VehicleModel();
+
+    // Load the model from JSON, missing options keep their current value
+    //   capacity (kWh), soc (%), taper_soc (%), charger_max (W), max_current (A), phases
+    bool deserialize(const char *json);
+
+    // The current (A per phase) the vehicle will draw for the given pilot
+    double getCurrent(double pilot, double voltage);
+
+    // Charge the battery at the given current for a number of seconds
+    void charge(double current, double voltage, double seconds);
+
+    double getPower(double current, double voltage) {
+      return current * voltage * _phases;
+    }
+
+    double getSoc() {
+      return _soc;
+    }
+
+    int getPhases() {
+      return _phases;
+    }
+};
+
+#endif // _DIVERT_SIM_VEHICLE_H
@@ -80,6 +80,7 @@ def test_config_defaults() -> None:
     assert config["mqtt_vehicle_range"] ==  ""
     assert config["mqtt_vehicle_eta"] ==  ""
     assert config["mqtt_announce_topic"] ==  "openevse/announce/7856"
+    assert config["mqtt_publish_format"] ==  "topics"
     assert config["ocpp_server"] ==  ""
     assert config["ocpp_chargeBoxId"] ==  ""
     assert config["ocpp_authkey"] ==  ""
@@ -108,6 +109,7 @@ def test_config_defaults() -> None:
     assert config["mqtt_enabled"] ==  False
     assert config["mqtt_reject_unauthorized"] ==  True
     assert config["mqtt_retained"] ==  False
+    assert config["mqtt_replay"] ==  False
     assert config["ohm_enabled"] ==  False
     assert config["sntp_enabled"] ==  True
     assert config["tesla_enabled"] ==  False
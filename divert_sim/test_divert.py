@@ -4,7 +4,7 @@
 # PYTHON_ARGCOMPLETE_OK
 # pylint: disable=line-too-long
 
-from run_simulations import run_simulation, setup_summary
+from run_simulations import run_simulation, run_sweep, setup_summary
 
 def setup():
     """Create the output directory and summary file"""
@@ -260,6 +260,19 @@ def test_divert_energy_and_power_day_2020_04_01_nowaste() -> None:
                 38.89, 38.16, 37.61, 0.55, 1, 28800, 28800, 28800,
                 separator=';', is_kw=True, config='data/config-inputfilter-nowaste.json')
 
+# sweep tests
+
+def test_divert_day1_sweep() -> None:
+    """Run the default and noimport profiles over the day1 dataset in a single sweep"""
+    results = run_sweep('day1', [
+        {"divert_attack_smoothing_time": 20, "divert_decay_smoothing_time": 600},
+        {"divert_attack_smoothing_time": 300, "divert_decay_smoothing_time": 20}
+    ])
+
+    assert len(results) == 2
+    assert results[0][1:] == (10.12, 7.4, 6.72, 0.67, 5, 660, 9780, 13500)
+    assert results[1][1:] == (10.12, 4.96, 4.71, 0.25, 6, 660, 2460, 7800)
+
 if __name__ == '__main__':
     # Run the script
     test_divert_almostperfect_default()
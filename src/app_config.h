@@ -64,6 +64,7 @@ extern String mqtt_vehicle_soc;
 extern String mqtt_vehicle_range;
 extern String mqtt_vehicle_eta;
 extern String mqtt_announce_topic;
+extern String mqtt_publish_format;
 
 // OCPP 1.6 Settings
 extern String ocpp_server;
@@ -129,6 +130,7 @@ extern uint32_t flags;
 #define CONFIG_THREEPHASE           (1 << 24)
 #define CONFIG_WIZARD               (1 << 25)
 #define CONFIG_DEFAULT_STATE        (1 << 26)
+#define CONFIG_MQTT_REPLAY          (1 << 27)
 
 #define INITIAL_CONFIG_VERSION  1
 
@@ -156,6 +158,10 @@ inline bool config_mqtt_retained() {
   return CONFIG_MQTT_RETAINED == (flags & CONFIG_MQTT_RETAINED);
 }
 
+inline bool config_mqtt_replay() {
+  return CONFIG_MQTT_REPLAY == (flags & CONFIG_MQTT_REPLAY);
+}
+
 inline bool config_mqtt_reject_unauthorized() {
   return 0 == (flags & CONFIG_MQTT_ALLOW_ANY_CERT);
 }
@@ -1,38 +1,61 @@
 #include "current_shaper.h"
 #include "input_filter.h"
+#include "event_bus.h"
+#include "meter_mailbox.h"
+#include "task_clock.h"
 
 //global instance
 CurrentShaperTask shaper;
 
 CurrentShaperTask::CurrentShaperTask() : MicroTasks::Task() {
+	_evse = &evse;
 	_changed = false;
 	_enabled = false;
 	_max_pwr = 0;
 	_live_pwr = 0;
+	_live_pwr_time = 0;
 	_smoothed_live_pwr = 0;
 	_chg_cur = 0;
 	_max_cur = 0;
 	_pause_timer = 0;
 	_timer = 0;
 	_updated = false;
+	_mailbox = -1;
 }
 
 CurrentShaperTask::~CurrentShaperTask() {
 	// should be useless but just in case
-	evse.release(EvseClient_OpenEVSE_Shaper);
+	_evse->release(EvseClient_OpenEVSE_Shaper);
 }
 
 void CurrentShaperTask::setup() {
-
+	_mailbox = meterMailbox.subscribe(
+		METER_INPUT_MASK(MeterInput_LivePwr) |
+		METER_INPUT_MASK(MeterInput_Solar) |
+		METER_INPUT_MASK(MeterInput_GridIe), this);
 }
 
 unsigned long CurrentShaperTask::loop(MicroTasks::WakeReason reason) {
 
+	// Only the latest of any samples received since the last run is used
+	uint32_t inputs = meterMailbox.take(_mailbox);
+	if (inputs & METER_INPUT_MASK(MeterInput_LivePwr)) {
+		_live_pwr = meterMailbox.get(MeterInput_LivePwr);
+		_live_pwr_time = meterMailbox.getTimestamp(MeterInput_LivePwr);
+		DBUGF("shaper: Live Pwr:%dW", _live_pwr);
+		shapeCurrent();
+	}
+	else if ((inputs & (METER_INPUT_MASK(MeterInput_Solar) | METER_INPUT_MASK(MeterInput_GridIe))) && _enabled) {
+		// the solar production is added to the max power, a new grid_ie also
+		// recalculates with the latest live power
+		shapeCurrent();
+	}
+
 	if (_enabled) {
 			EvseProperties props;
 			if (_changed) {
 				props.setMaxCurrent(floor(_max_cur));
-				if (_max_cur < evse.getMinCurrent()) {
+				if (_max_cur < _evse->getMinCurrent()) {
 					// pause temporary, not enough amps available
 					props.setState(EvseState::Disabled);
 					if (!_pause_timer)
@@ -41,7 +64,7 @@ unsigned long CurrentShaperTask::loop(MicroTasks::WakeReason reason) {
 					}
 
 				}
-				else if (millis() - _pause_timer >= current_shaper_min_pause_time * 1000 && (_max_cur - evse.getMinCurrent() >= EVSE_SHAPER_HYSTERESIS))
+				else if (millis() - _pause_timer >= current_shaper_min_pause_time * 1000 && (_max_cur - _evse->getMinCurrent() >= EVSE_SHAPER_HYSTERESIS))
 				{
 					_pause_timer = 0;
 					props.setState(EvseState::None);
@@ -49,17 +72,15 @@ unsigned long CurrentShaperTask::loop(MicroTasks::WakeReason reason) {
 				_timer = millis();
 				_changed = false;
 				// claim only if we have change
-				if (evse.getState() != props.getState() || evse.getChargeCurrent() != props.getChargeCurrent())
+				if (_evse->getState() != props.getState() || _evse->getChargeCurrent() != props.getChargeCurrent())
 				{
-					evse.claim(EvseClient_OpenEVSE_Shaper, EvseManager_Priority_Safety, props);
-					StaticJsonDocument<128> event;
-					event["shaper"] = 1;
-					event["shaper_live_pwr"] = _live_pwr;
-					event["shaper_smoothed_live_pwr"] = _smoothed_live_pwr;
-					event["shaper_max_pwr"] = _max_pwr;
-					event["shaper_cur"] = _max_cur;
-					event["shaper_updated"] = _updated;
-					event_send(event);
+					_evse->claim(EvseClient_OpenEVSE_Shaper, EvseManager_Priority_Safety, props);
+					eventBus.setInt(EventField_Shaper, 1);
+					eventBus.setInt(EventField_ShaperLivePwr, _live_pwr);
+					eventBus.setDouble(EventField_ShaperSmoothedLivePwr, _smoothed_live_pwr);
+					eventBus.setInt(EventField_ShaperMaxPwr, _max_pwr);
+					eventBus.setDouble(EventField_ShaperCur, _max_cur);
+					eventBus.setBool(EventField_ShaperUpdated, _updated);
 				}
 			}
 			else if ( !_updated || millis() - _timer > current_shaper_data_maxinterval * 1000 )
@@ -74,18 +95,16 @@ unsigned long CurrentShaperTask::loop(MicroTasks::WakeReason reason) {
 					_smoothed_live_pwr = _live_pwr;
 				}
 
-				if (evse.getState(EvseClient_OpenEVSE_Shaper) != EvseState::Disabled)
+				if (_evse->getState(EvseClient_OpenEVSE_Shaper) != EvseState::Disabled)
 				{
 					props.setState(EvseState::Disabled);
-					evse.claim(EvseClient_OpenEVSE_Shaper, EvseManager_Priority_Limit, props);
-					StaticJsonDocument<128> event;
-					event["shaper"] = 1;
-					event["shaper_live_pwr"] = _live_pwr;
-					event["shaper_smoothed_live_pwr"] = _smoothed_live_pwr;
-					event["shaper_max_pwr"] = _max_pwr;
-					event["shaper_cur"] = _max_cur;
-					event["shaper_updated"] = _updated;
-					event_send(event);
+					_evse->claim(EvseClient_OpenEVSE_Shaper, EvseManager_Priority_Limit, props);
+					eventBus.setInt(EventField_Shaper, 1);
+					eventBus.setInt(EventField_ShaperLivePwr, _live_pwr);
+					eventBus.setDouble(EventField_ShaperSmoothedLivePwr, _smoothed_live_pwr);
+					eventBus.setInt(EventField_ShaperMaxPwr, _max_pwr);
+					eventBus.setDouble(EventField_ShaperCur, _max_cur);
+					eventBus.setBool(EventField_ShaperUpdated, _updated);
 				}
 			}
 	}
@@ -97,7 +116,7 @@ unsigned long CurrentShaperTask::loop(MicroTasks::WakeReason reason) {
 		}
 	}
 
-	return EVSE_SHAPER_LOOP_TIME;
+	return TASK_CLOCK_SCHEDULE(this, EVSE_SHAPER_LOOP_TIME);
 }
 
 void CurrentShaperTask::begin(EvseManager &evse) {
@@ -119,7 +138,7 @@ void CurrentShaperTask::notifyConfigChanged( bool enabled, uint32_t max_pwr) {
 	DBUGF("CurrentShaper: got config changed");
 	_enabled = enabled;
 	_max_pwr = max_pwr;
-	if (!enabled) evse.release(EvseClient_OpenEVSE_Shaper);
+	if (!enabled) _evse->release(EvseClient_OpenEVSE_Shaper);
 	StaticJsonDocument<128> event;
 	event["shaper"] = enabled == true ? 1 : 0;
 	event["shaper_max_pwr"] = max_pwr;
@@ -131,8 +150,9 @@ void CurrentShaperTask::setMaxPwr(int max_pwr) {
 		shapeCurrent();
 }
 
-void CurrentShaperTask::setLivePwr(int live_pwr) {
+void CurrentShaperTask::setLivePwr(int live_pwr, uint32_t timestamp) {
 	_live_pwr = live_pwr;
+	_live_pwr_time = timestamp;
 	shapeCurrent();
 }
 
@@ -141,7 +161,7 @@ void CurrentShaperTask::setState(bool state) {
 	_enabled = state;
 	if (!_enabled) {
 		//remove claim
-		evse.release(EvseClient_OpenEVSE_Shaper);
+		_evse->release(EvseClient_OpenEVSE_Shaper);
 	}
 	StaticJsonDocument<128> event;
 	event["shaper"]  = state?1:0;
@@ -164,25 +184,25 @@ void CurrentShaperTask::shapeCurrent() {
 			_smoothed_live_pwr = _live_pwr;
 		}
 		else {
-			_smoothed_live_pwr = _inputFilter.filter(_live_pwr, _smoothed_live_pwr, current_shaper_smoothing_time);
+			_smoothed_live_pwr = _inputFilter.filter(_live_pwr, _smoothed_live_pwr, current_shaper_smoothing_time, _live_pwr_time);
 		}
 		livepwr = _smoothed_live_pwr;
 	}
 
 	if (config_divert_enabled() == true) {
 		if ( divert_type == DIVERT_TYPE_SOLAR ) {
-			max_pwr += solar;
+			max_pwr += meterMailbox.get(MeterInput_Solar);
 		}
 	}
 //	if (livepwr > max_pwr) {
 //		livepwr = max_pwr;
 //	}
 	if(!config_threephase_enabled()) {
-		_max_cur = ((max_pwr - livepwr) / evse.getVoltage()) + evse.getAmps();
+		_max_cur = ((max_pwr - livepwr) / _evse->getVoltage()) + _evse->getAmps();
 	 }
 
 	else {
-		_max_cur = ((max_pwr - livepwr) / evse.getVoltage() / 3.0) + evse.getAmps();
+		_max_cur = ((max_pwr - livepwr) / _evse->getVoltage() / 3.0) + _evse->getAmps();
 	}
 
 
@@ -33,6 +33,7 @@ class CurrentShaperTask: public MicroTasks::Task
     bool         _changed;
     int          _max_pwr;   // total current available from the grid
     int          _live_pwr;  // current available to EVSE
+    uint32_t     _live_pwr_time; // millis() _live_pwr was measured at
     double       _smoothed_live_pwr; // filtered live power for getting out of pause only
     uint8_t      _chg_cur;   // calculated charge current to claim
     double       _max_cur;   // shaper calculated max current
@@ -40,6 +41,7 @@ class CurrentShaperTask: public MicroTasks::Task
     uint32_t     _pause_timer;
     bool         _updated;
     InputFilter  _inputFilter;
+    int          _mailbox;
 
   protected:
     void setup();
@@ -51,7 +53,7 @@ class CurrentShaperTask: public MicroTasks::Task
     void begin(EvseManager &evse);
     void shapeCurrent();
     void setMaxPwr(int max_pwr);
-    void setLivePwr(int live_pwr);
+    void setLivePwr(int live_pwr, uint32_t timestamp);
     void setState(bool state);
     bool getState();
     int getMaxPwr();
@@ -11,6 +11,10 @@
 #include "divert.h"
 #include "emoncms.h"
 #include "event.h"
+#include "event_bus.h"
+#include "meter_mailbox.h"
+#include "app_config.h"
+#include "task_clock.h"
 
 #include <sys/time.h>
 
@@ -37,8 +41,6 @@
 
 // Default to normal charging unless set. Divert mode always defaults back to 1 if unit is reset (_mode not saved in EEPROM)
 
-int solar = 0;
-int grid_ie = 0;
 
 // define as 'weak' so the simulator can override
 time_t __attribute__((weak)) divertmode_get_time()
@@ -57,7 +59,8 @@ DivertTask::DivertTask(EvseManager &evse) :
   _evseState(this),
   _available_current(0),
   _smoothed_available_current(0),
-  _min_charge_end(0)
+  _min_charge_end(0),
+  _mailbox(-1)
 {
 
 }
@@ -78,6 +81,10 @@ void DivertTask::begin()
 void DivertTask::setup()
 {
   _evse->onStateChange(&_evseState);
+  _mailbox = meterMailbox.subscribe(
+    METER_INPUT_MASK(MeterInput_Solar) |
+    METER_INPUT_MASK(MeterInput_GridIe) |
+    METER_INPUT_MASK(MeterInput_Voltage), this);
 }
 
 unsigned long DivertTask::loop(MicroTasks::WakeReason reason)
@@ -97,7 +104,21 @@ unsigned long DivertTask::loop(MicroTasks::WakeReason reason)
     }
   }
 
-  return MicroTask.Infinate;
+  // Only the latest of any samples received since the last run is used
+  uint32_t inputs = meterMailbox.take(_mailbox);
+  if(inputs & METER_INPUT_MASK(MeterInput_Voltage))
+  {
+    double volts = meterMailbox.get(MeterInput_Voltage);
+    DBUGF("voltage:%.1f", volts);
+    _evse->setVoltage(volts);
+  }
+  if(inputs & (METER_INPUT_MASK(MeterInput_Solar) | METER_INPUT_MASK(MeterInput_GridIe)))
+  {
+    MeterInput input = DIVERT_TYPE_SOLAR == divert_type ? MeterInput_Solar : MeterInput_GridIe;
+    update_state(meterMailbox.getTimestamp(input));
+  }
+
+  return TASK_CLOCK_SCHEDULE(this, MicroTask.Infinate);
 }
 
 // Update divert mode e.g. Normal / Eco
@@ -109,10 +130,9 @@ void DivertTask::setMode(DivertMode mode)
   {
     _mode = mode;
 
-    StaticJsonDocument<128> event;
-    event["divertmode"] = (uint8_t)_mode;
+    eventBus.setInt(EventField_DivertMode, (uint8_t)_mode);
     _state = EvseState::None;
-    event["divert_active"] = false;
+    eventBus.setBool(EventField_DivertActive, false);
 
     switch(_mode)
     {
@@ -124,9 +144,9 @@ void DivertTask::setMode(DivertMode mode)
       {
         _min_charge_end = 0;
 
-        event["charge_rate"] = _charge_rate = 0;
-        event["available_current"] = _available_current = 0;
-        event["smoothed_available_current"] = _smoothed_available_current = 0;
+        eventBus.setInt(EventField_ChargeRate, _charge_rate = 0);
+        eventBus.setDouble(EventField_AvailableCurrent, _available_current = 0);
+        eventBus.setDouble(EventField_SmoothedAvailableCurrent, _smoothed_available_current = 0);
 
         EvseProperties props(EvseState::Disabled);
         _evse->claim(EvseClient_OpenEVSE_Divert, EvseManager_Priority_Default, props);
@@ -135,26 +155,30 @@ void DivertTask::setMode(DivertMode mode)
       default:
         return;
     }
-
-    event_send(event);
   }
 }
 
 // Set charge rate depending on divert mode and solar / grid_ie
-void DivertTask::update_state()
+void DivertTask::update_state(uint32_t timestamp)
 {
   Profile_Start(DivertTask::update_state);
 
-  StaticJsonDocument<256> event;
-  event["divert_update"] = 0;
+  // The fields updated, these are also sent to EmonCMS
+  uint64_t fields = EVENT_FIELD_MASK(EventField_DivertUpdate);
+  eventBus.setInt(EventField_DivertUpdate, 0);
+
+  int solar = meterMailbox.get(MeterInput_Solar);
+  int grid_ie = meterMailbox.get(MeterInput_GridIe);
 
   if (divert_type == DIVERT_TYPE_GRID)
   {
-    event["grid_ie"] = grid_ie;
+    eventBus.setInt(EventField_GridIe, grid_ie);
+    fields |= EVENT_FIELD_MASK(EventField_GridIe);
   }
   else if (divert_type == DIVERT_TYPE_SOLAR)
   {
-    event["solar"] = solar;
+    eventBus.setInt(EventField_Solar, solar);
+    fields |= EVENT_FIELD_MASK(EventField_Solar);
   }
 
   // If divert mode = Eco (2)
@@ -212,7 +236,7 @@ void DivertTask::update_state()
     double scale = (_available_current > _smoothed_available_current ?
                       divert_attack_smoothing_time :
                       divert_decay_smoothing_time);
-    _smoothed_available_current = _inputFilter.filter(_available_current, _smoothed_available_current, scale);
+    _smoothed_available_current = _inputFilter.filter(_available_current, _smoothed_available_current, scale, timestamp);
     DBUGVAR(_smoothed_available_current);
 
     _charge_rate = (int)floor(_available_current);
@@ -254,18 +278,23 @@ void DivertTask::update_state()
       }
     }
 
-    event["divert_active"] = isActive();
-    event["charge_rate"] = _charge_rate;
-    event["trigger_current"] = trigger_current;
-    event["voltage"] = voltage;
-    event["available_current"] = _available_current;
-    event["smoothed_available_current"] = _smoothed_available_current;
-    event["pilot"] = _evse->getChargeCurrent();
-    event["min_charge_end"] = min_charge_time_remaining;
+    eventBus.setBool(EventField_DivertActive, isActive());
+    eventBus.setInt(EventField_ChargeRate, _charge_rate);
+    eventBus.setDouble(EventField_TriggerCurrent, trigger_current);
+    eventBus.setDouble(EventField_Voltage, voltage);
+    eventBus.setDouble(EventField_AvailableCurrent, _available_current);
+    eventBus.setDouble(EventField_SmoothedAvailableCurrent, _smoothed_available_current);
+    eventBus.setInt(EventField_Pilot, _evse->getChargeCurrent());
+    eventBus.setInt(EventField_MinChargeEnd, min_charge_time_remaining);
+    fields |= EVENT_FIELDS_DIVERT_ECO;
   } // end ecomode
 
-  event_send(event);
-  emoncms_publish(event);
+  if (config_emoncms_enabled())
+  {
+    StaticJsonDocument<EVENT_BUS_DOC_SIZE> data;
+    eventBus.serialize(data, fields);
+    emoncms_publish(data);
+  }
 
   _last_update = millis();
 
@@ -21,9 +21,6 @@ enum divert_type {
   DIVERT_TYPE_GRID = 1
 };
 
-extern int solar;
-extern int grid_ie;
-
 class DivertMode
 {
   public:
@@ -66,6 +63,7 @@ class DivertTask : public MicroTasks::Task
     time_t _min_charge_end;
     uint8_t _evse_last_state;
     InputFilter _inputFilter;
+    int _mailbox;
 
   protected:
     void setup();
@@ -99,8 +97,10 @@ class DivertTask : public MicroTasks::Task
       return _smoothed_available_current;
     }
 
-    // Set charge rate depending on charge mode and solarPV output
-    void update_state();
+    // Set charge rate depending on charge mode and the latest solar or grid_ie in
+    // meterMailbox, timestamp is the millis() the sample was measured at. The meter
+    // inputs posted to meterMailbox call this from the task loop
+    void update_state(uint32_t timestamp);
 
     EvseState getState() {
       return _state;
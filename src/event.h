@@ -4,7 +4,6 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
-void event_send(String &event);
 void event_send(JsonDocument &event);
 
 #endif
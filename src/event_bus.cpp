@@ -0,0 +1,185 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_EVENT_BUS)
+#undef ENABLE_DEBUG
+#endif
+
+#include "event_bus.h"
+#include "task_clock.h"
+#include "debug.h"
+
+EventBus eventBus;
+
+const char * const EventBus::_names[EventField_Count] = {
+  "state",
+  "flags",
+  "vehicle",
+  "colour",
+  "pilot",
+  "max_current",
+  "manual_override",
+  "status",
+  "elapsed",
+  "amp",
+  "voltage",
+  "power",
+
+  "claims_version",
+  "override_version",
+
+  "divert_update",
+  "divertmode",
+  "grid_ie",
+  "solar",
+  "divert_active",
+  "charge_rate",
+  "trigger_current",
+  "available_current",
+  "smoothed_available_current",
+  "min_charge_end",
+
+  "shaper",
+  "shaper_live_pwr",
+  "shaper_smoothed_live_pwr",
+  "shaper_max_pwr",
+  "shaper_cur",
+  "shaper_updated"
+};
+
+EventBus::EventBus() :
+  MicroTasks::Task(),
+  _fields(),
+  _changed(0),
+  _running(false),
+  _sinks(),
+  _sinkCount(0),
+  _frame(NULL),
+  _frameSize(0)
+{
+}
+
+void EventBus::begin()
+{
+  MicroTask.startTask(this);
+  _running = true;
+}
+
+void EventBus::setup()
+{
+}
+
+unsigned long EventBus::loop(MicroTasks::WakeReason reason)
+{
+  flush();
+  return TASK_CLOCK_SCHEDULE(this, MicroTask.Infinate);
+}
+
+bool EventBus::onFlush(EventBusSink sink)
+{
+  if(_sinkCount >= EVENT_BUS_MAX_SINKS) {
+    return false;
+  }
+
+  _sinks[_sinkCount++] = sink;
+  return true;
+}
+
+void EventBus::changed(EventField field)
+{
+  if(0 == _changed && _running) {
+    MicroTask.wakeTask(this);
+  }
+  _changed |= EVENT_FIELD_MASK(field);
+}
+
+void EventBus::setInt(EventField field, long value)
+{
+  _fields[field].type = FieldType_Int;
+  _fields[field].value.i = value;
+  changed(field);
+}
+
+void EventBus::setDouble(EventField field, double value)
+{
+  _fields[field].type = FieldType_Double;
+  _fields[field].value.d = value;
+  changed(field);
+}
+
+void EventBus::setBool(EventField field, bool value)
+{
+  _fields[field].type = FieldType_Bool;
+  _fields[field].value.b = value;
+  changed(field);
+}
+
+void EventBus::setString(EventField field, const char *value)
+{
+  _fields[field].type = FieldType_String;
+  _fields[field].value.s = value;
+  changed(field);
+}
+
+void EventBus::flush()
+{
+  if(0 == _changed) {
+    return;
+  }
+
+  uint64_t fields = _changed;
+  _changed = 0;
+
+  if(0 == _sinkCount) {
+    return;
+  }
+
+  StaticJsonDocument<EVENT_BUS_DOC_SIZE> event;
+  serialize(event, fields);
+
+  size_t length = measureJson(event);
+  if(length + 1 > _frameSize)
+  {
+    char *frame = (char *)realloc(_frame, length + 1);
+    if(NULL != frame) {
+      _frame = frame;
+      _frameSize = length + 1;
+    }
+  }
+
+  EventBusFrame flushed = { event, fields, NULL, 0 };
+  if(length + 1 <= _frameSize)
+  {
+    flushed.json = _frame;
+    flushed.length = serializeJson(event, _frame, _frameSize);
+    DBUGF("Flushing %s", _frame);
+  }
+
+  for(uint8_t i = 0; i < _sinkCount; i++) {
+    _sinks[i](flushed);
+  }
+}
+
+void EventBus::serialize(JsonDocument &doc, uint64_t mask)
+{
+  for(uint8_t i = 0; i < EventField_Count; i++)
+  {
+    if(0 == (mask & EVENT_FIELD_MASK(i))) {
+      continue;
+    }
+
+    Field &field = _fields[i];
+    switch(field.type)
+    {
+      case FieldType_Int:
+        doc[_names[i]] = field.value.i;
+        break;
+      case FieldType_Double:
+        doc[_names[i]] = field.value.d;
+        break;
+      case FieldType_Bool:
+        doc[_names[i]] = field.value.b;
+        break;
+      case FieldType_String:
+        doc[_names[i]] = field.value.s;
+        break;
+    }
+  }
+}
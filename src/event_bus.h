@@ -0,0 +1,151 @@
+#ifndef _OPENEVSE_EVENT_BUS_H
+#define _OPENEVSE_EVENT_BUS_H
+
+#ifndef EVENT_BUS_MAX_SINKS
+#define EVENT_BUS_MAX_SINKS 4
+#endif
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <MicroTasks.h>
+#include <functional>
+
+// The pre-registered event fields, the order must match the names in event_bus.cpp
+enum EventField : uint8_t
+{
+  // EVSE status
+  EventField_State,
+  EventField_Flags,
+  EventField_Vehicle,
+  EventField_Colour,
+  EventField_Pilot,
+  EventField_MaxCurrent,
+  EventField_ManualOverride,
+  EventField_Status,
+  EventField_Elapsed,
+  EventField_Amp,
+  EventField_Voltage,
+  EventField_Power,
+
+  // Claims
+  EventField_ClaimsVersion,
+  EventField_OverrideVersion,
+
+  // Solar divert
+  EventField_DivertUpdate,
+  EventField_DivertMode,
+  EventField_GridIe,
+  EventField_Solar,
+  EventField_DivertActive,
+  EventField_ChargeRate,
+  EventField_TriggerCurrent,
+  EventField_AvailableCurrent,
+  EventField_SmoothedAvailableCurrent,
+  EventField_MinChargeEnd,
+
+  // Current shaper
+  EventField_Shaper,
+  EventField_ShaperLivePwr,
+  EventField_ShaperSmoothedLivePwr,
+  EventField_ShaperMaxPwr,
+  EventField_ShaperCur,
+  EventField_ShaperUpdated,
+
+  EventField_Count
+};
+
+#define EVENT_FIELD_MASK(field) (1ULL << (field))
+
+// The fields updated by the divert in Eco mode
+#define EVENT_FIELDS_DIVERT_ECO ( \
+  EVENT_FIELD_MASK(EventField_DivertActive) | \
+  EVENT_FIELD_MASK(EventField_ChargeRate) | \
+  EVENT_FIELD_MASK(EventField_TriggerCurrent) | \
+  EVENT_FIELD_MASK(EventField_Voltage) | \
+  EVENT_FIELD_MASK(EventField_AvailableCurrent) | \
+  EVENT_FIELD_MASK(EventField_SmoothedAvailableCurrent) | \
+  EVENT_FIELD_MASK(EventField_Pilot) | \
+  EVENT_FIELD_MASK(EventField_MinChargeEnd))
+
+// Enough for every field, keys and string values are stored as pointers
+#define EVENT_BUS_DOC_SIZE JSON_OBJECT_SIZE(EventField_Count)
+
+// What is handed to the sinks on a flush, the changed fields as a document and
+// that document serialised as JSON. json is NULL if the frame could not be
+// allocated.
+struct EventBusFrame
+{
+  JsonDocument &event;
+  uint64_t fields;
+  const char *json;
+  size_t length;
+};
+
+typedef std::function<void(const EventBusFrame &frame)> EventBusSink;
+
+// Typed event bus for the high rate status events. Producers set fields without
+// building a JSON document, the changed fields are coalesced and then serialised
+// once per flush, from the bus task, and handed to each of the sinks.
+class EventBus : public MicroTasks::Task
+{
+  private:
+    enum FieldType : uint8_t {
+      FieldType_Int,
+      FieldType_Double,
+      FieldType_Bool,
+      FieldType_String
+    };
+
+    struct Field {
+      FieldType type;
+      union {
+        long i;
+        double d;
+        bool b;
+        const char *s;
+      } value;
+    };
+
+    static const char * const _names[EventField_Count];
+
+    Field _fields[EventField_Count];
+    uint64_t _changed;
+    bool _running;
+
+    EventBusSink _sinks[EVENT_BUS_MAX_SINKS];
+    uint8_t _sinkCount;
+
+    // The serialised frame, grown to the largest flush
+    char *_frame;
+    size_t _frameSize;
+
+    void changed(EventField field);
+
+  protected:
+    void setup();
+    unsigned long loop(MicroTasks::WakeReason reason);
+
+  public:
+    EventBus();
+
+    void begin();
+
+    // Add a consumer of the flushed events
+    bool onFlush(EventBusSink sink);
+
+    void setInt(EventField field, long value);
+    void setDouble(EventField field, double value);
+    void setBool(EventField field, bool value);
+    // value must remain valid until flushed, eg a string constant
+    void setString(EventField field, const char *value);
+
+    // Send any changed fields to the sinks now
+    void flush();
+
+    // Add the current value of the fields in mask to doc
+    void serialize(JsonDocument &doc, uint64_t mask);
+};
+
+extern EventBus eventBus;
+
+#endif // _OPENEVSE_EVENT_BUS_H
@@ -8,10 +8,23 @@
 #include "debug.h"
 #include "emonesp.h"
 #include "event_log.h"
+#include "event_log_codec.h"
+#include "task_clock.h"
+
+// Where a block is compressed to before it replaces the original
+#define EVENTLOG_TEMP_FILE EVENTLOG_BASE_DIRECTORY ".tmp"
 
 EventLog::EventLog() :
+  MicroTasks::Task(),
   _min_log_index(0),
-  _max_log_index(0)
+  _max_log_index(0),
+  _blocks(),
+  _buffer(),
+  _buffered(0),
+  _firstBuffered(0),
+  _urgent(false),
+  _lastManagerState(EvseState::None),
+  _running(false)
 {
 }
 
@@ -37,8 +50,72 @@ uint32_t EventLog::indexFromFilename(String &path)
   return atol(name.c_str());
 }
 
+void EventLogEntry::seal()
+{
+  version = EVENTLOG_RECORD_VERSION;
+  crc = calculateCrc((const uint8_t *)this, offsetof(EventLogEntry, crc));
+}
+
+bool EventLogEntry::isValid() const
+{
+  return EVENTLOG_RECORD_VERSION == version &&
+         crc == calculateCrc((const uint8_t *)this, offsetof(EventLogEntry, crc));
+}
+
+size_t EventLogEntry::formatTime(char *buffer, size_t size) const
+{
+  time_t t = time;
+  struct tm timeinfo;
+  gmtime_r(&t, &timeinfo);
+  return strftime(buffer, size, "%FT%TZ", &timeinfo);
+}
+
+uint32_t EventLogEntry::timeFromCivil(int year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second)
+{
+  year -= month <= 2;
+  int32_t era = year / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + (int32_t)doe - 719468;
+  return days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
+
+// CRC-16/CCITT-FALSE
+uint16_t EventLogEntry::calculateCrc(const uint8_t *data, size_t length, uint16_t crc)
+{
+  for(size_t i = 0; i < length; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for(int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+void EventLogBlockInfo::add(const EventLogEntry &entry)
+{
+  if(0 == count || entry.time < start) {
+    start = entry.time;
+  }
+  if(0 == count || entry.time > end) {
+    end = entry.time;
+  }
+  count++;
+  types |= EVENTLOG_TYPE_MASK(entry.type);
+}
+
+static int16_t temperatureToInt(double temperature)
+{
+  double value = round(temperature * 10);
+  return value > INT16_MAX ? INT16_MAX :
+         value < INT16_MIN ? INT16_MIN :
+         (int16_t)value;
+}
+
 // Scan our base directory for existing log files and workout the min/max index files
-void EventLog::begin()
+void EventLog::scan()
 {
   File eventLog = LittleFS.open(EVENTLOG_BASE_DIRECTORY);
   if(eventLog && eventLog.isDirectory())
@@ -70,6 +147,27 @@ void EventLog::begin()
     if(UINT32_MAX == _min_log_index) {
       _min_log_index = 0;
     }
+
+    // Only as many blocks as can be indexed are kept
+    while((_max_log_index + 1) - _min_log_index > EVENTLOG_MAX_BLOCKS) {
+      removeOldest();
+    }
+
+    for(uint32_t index = _min_log_index; index <= _max_log_index; index++)
+    {
+      bool converted = convertBlock(index);
+      indexBlock(index);
+      if(converted && index < _max_log_index) {
+        compressBlock(index);
+      }
+    }
+    trim();
+
+    // Only the newest block can be appended to, if it has been compressed start
+    // a new one
+    if(blockInfo(_max_log_index).compressed) {
+      rotate();
+    }
   }
   else
   {
@@ -77,6 +175,139 @@ void EventLog::begin()
   }
 }
 
+// The manifest header, followed by the EventLogBlockInfo of each block and a CRC
+struct __attribute__((packed)) EventLogManifest
+{
+  uint8_t version;
+  uint16_t blocks;
+  uint32_t minIndex;
+  uint32_t maxIndex;
+};
+
+bool EventLog::loadManifest()
+{
+  File file = LittleFS.open(EVENTLOG_MANIFEST_FILE);
+  if(!file) {
+    return false;
+  }
+
+  EventLogManifest manifest;
+  bool valid =
+    sizeof(manifest) == file.read((uint8_t *)&manifest, sizeof(manifest)) &&
+    EVENTLOG_MANIFEST_VERSION == manifest.version &&
+    manifest.maxIndex >= manifest.minIndex &&
+    manifest.blocks == (manifest.maxIndex + 1) - manifest.minIndex &&
+    manifest.blocks <= EVENTLOG_MAX_BLOCKS;
+
+  // Read straight into the index, if the manifest turns out to be invalid the
+  // scan replaces it
+  uint16_t crc = EventLogEntry::calculateCrc((const uint8_t *)&manifest, sizeof(manifest));
+  for(uint32_t i = 0; valid && i < manifest.blocks; i++)
+  {
+    EventLogBlockInfo &info = blockInfo(manifest.minIndex + i);
+    valid = sizeof(info) == file.read((uint8_t *)&info, sizeof(info));
+    crc = EventLogEntry::calculateCrc((const uint8_t *)&info, sizeof(info), crc);
+  }
+
+  uint16_t savedCrc;
+  valid = valid &&
+    sizeof(savedCrc) == file.read((uint8_t *)&savedCrc, sizeof(savedCrc)) &&
+    savedCrc == crc;
+  file.close();
+
+  // Check the manifest matches the files, it is written after a rotation so the
+  // oldest block is removed first and the newest may not have been created yet
+  valid = valid &&
+    LittleFS.exists(EVENTLOG_BASE_DIRECTORY) &&
+    (LittleFS.exists(filenameFromIndex(manifest.minIndex)) || manifest.minIndex == manifest.maxIndex) &&
+    (0 == manifest.minIndex || !LittleFS.exists(filenameFromIndex(manifest.minIndex - 1))) &&
+    !LittleFS.exists(filenameFromIndex(manifest.maxIndex + 1));
+  if(!valid)
+  {
+    DBUGLN("Event log manifest invalid");
+    return false;
+  }
+
+  _min_log_index = manifest.minIndex;
+  _max_log_index = manifest.maxIndex;
+
+  return true;
+}
+
+void EventLog::saveManifest()
+{
+  EventLogManifest manifest;
+  manifest.version = EVENTLOG_MANIFEST_VERSION;
+  manifest.blocks = (_max_log_index + 1) - _min_log_index;
+  manifest.minIndex = _min_log_index;
+  manifest.maxIndex = _max_log_index;
+
+  // Written to a temporary file and renamed so a reset part way through leaves
+  // the old manifest
+  String tempFilename = EVENTLOG_MANIFEST_FILE ".tmp";
+  File file = LittleFS.open(tempFilename, FILE_WRITE);
+  if(!file) {
+    return;
+  }
+
+  uint16_t crc = EventLogEntry::calculateCrc((const uint8_t *)&manifest, sizeof(manifest));
+  size_t written = file.write((const uint8_t *)&manifest, sizeof(manifest));
+  for(uint32_t index = _min_log_index; index <= _max_log_index; index++)
+  {
+    EventLogBlockInfo &info = blockInfo(index);
+    crc = EventLogEntry::calculateCrc((const uint8_t *)&info, sizeof(info), crc);
+    written += file.write((const uint8_t *)&info, sizeof(info));
+  }
+  written += file.write((const uint8_t *)&crc, sizeof(crc));
+  file.close();
+
+  if(written != sizeof(manifest) + manifest.blocks * sizeof(EventLogBlockInfo) + sizeof(crc) ||
+     !LittleFS.rename(tempFilename, EVENTLOG_MANIFEST_FILE))
+  {
+    DBUGLN("Failed to save event log manifest");
+    LittleFS.remove(tempFilename);
+  }
+}
+
+void EventLog::begin()
+{
+  if(loadManifest())
+  {
+    // Only the newest block has changed since the manifest was written
+    indexBlock(_max_log_index);
+  }
+  else
+  {
+    scan();
+    saveManifest();
+  }
+
+  DBUGF("Event log blocks %d-%d", _min_log_index, _max_log_index);
+
+  MicroTask.startTask(this);
+  _running = true;
+}
+
+void EventLog::setup()
+{
+}
+
+unsigned long EventLog::loop(MicroTasks::WakeReason reason)
+{
+  if(0 == _buffered) {
+    return TASK_CLOCK_SCHEDULE(this, MicroTask.Infinate);
+  }
+
+  unsigned long waiting = millis() - _firstBuffered;
+  if(_urgent || _buffered >= EVENTLOG_BUFFER_COUNT || waiting >= EVENTLOG_FLUSH_TIME)
+  {
+    flush();
+    return TASK_CLOCK_SCHEDULE(this, MicroTask.Infinate);
+  }
+
+  return TASK_CLOCK_SCHEDULE(this, EVENTLOG_FLUSH_TIME - waiting);
+}
+
 void EventLog::log(EventType type, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper)
 {
   time_t now = time(NULL);
@@ -88,92 +319,357 @@ void EventLog::log(EventType type, EvseState managerState, uint8_t evseState, ui
     return;
   }
 
-  String eventFilename = filenameFromIndex(_max_log_index);
-  File eventFile = LittleFS.open(eventFilename, FILE_APPEND);
-  if(eventFile && eventFile.size() > EVENTLOG_ROTATE_SIZE)
+  // No room left, the task has not got round to it yet
+  if(_buffered >= EVENTLOG_BUFFER_COUNT)
+  {
+    flush();
+    if(_buffered >= EVENTLOG_BUFFER_COUNT) {
+      DBUGLN("Event log full, dropping event");
+      return;
+    }
+  }
+
+  EventLogEntry &entry = _buffer[_buffered];
+  entry.type = type.toInt();
+  entry.managerState = (EvseState::Value)managerState;
+  entry.evseState = evseState;
+  entry.time = now;
+  entry.evseFlags = evseFlags;
+  entry.pilot = pilot;
+  entry.energy = energy;
+  entry.elapsed = elapsed;
+  entry.temperature = temperatureToInt(temperature);
+  entry.temperatureMax = temperatureToInt(temperatureMax);
+  entry.divertMode = divertMode;
+  entry.shaper = shaper;
+  entry.seal();
+
+  DBUGF("Event type %d, state %s, evse %d, flags %x, pilot %d, energy %.1f",
+    entry.type, managerState.toString(), evseState, evseFlags, pilot, energy);
+
+  if(0 == _buffered++) {
+    _firstBuffered = millis();
+  }
+
+  if(EventType::Warning == type || entry.managerState != _lastManagerState) {
+    _urgent = true;
+  }
+  _lastManagerState = entry.managerState;
+
+  if(_running) {
+    MicroTask.wakeTask(this);
+  } else if(_urgent || _buffered >= EVENTLOG_BUFFER_COUNT) {
+    flush();
+  }
+}
+
+void EventLog::flush()
+{
+  uint8_t written = 0;
+  while(written < _buffered)
+  {
+    EventLogBlockInfo &info = blockInfo(_max_log_index);
+    if(info.compressed) {
+      rotate();
+      continue;
+    }
+
+    File eventFile = LittleFS.open(filenameFromIndex(_max_log_index), FILE_APPEND);
+    if(!eventFile) {
+      break;
+    }
+
+    size_t size = eventFile.size();
+    if(size + sizeof(EventLogEntry) > EVENTLOG_ROTATE_SIZE)
+    {
+      eventFile.close();
+      rotate();
+      continue;
+    }
+
+    // As many as fit in the block
+    size_t count = (EVENTLOG_ROTATE_SIZE - size) / sizeof(EventLogEntry);
+    if(count > (size_t)(_buffered - written)) {
+      count = _buffered - written;
+    }
+    eventFile.write((const uint8_t *)&_buffer[written], count * sizeof(EventLogEntry));
+    eventFile.close();
+
+    for(size_t i = 0; i < count; i++) {
+      info.add(_buffer[written + i]);
+    }
+    info.size = size + count * sizeof(EventLogEntry);
+    written += count;
+  }
+
+  DBUGF("Wrote %d events", written);
+  if(written < _buffered) {
+    memmove(_buffer, &_buffer[written], (_buffered - written) * sizeof(EventLogEntry));
+  }
+  _buffered -= written;
+  _urgent = false;
+}
+
+void EventLog::enumerate(uint32_t index, std::function<void(const EventLogEntry &entry)> callback)
+{
+  // Make sure the latest events are included
+  if(index == _max_log_index && _buffered > 0) {
+    flush();
+  }
+
+  readBlock(index, callback);
+}
+
+bool EventLog::readBlock(uint32_t index, std::function<void(const EventLogEntry &entry)> callback)
+{
+  File eventFile = LittleFS.open(filenameFromIndex(index));
+  if(!eventFile) {
+    return false;
+  }
+
+  if(EVENTLOG_COMPRESSED_VERSION == eventFile.peek())
   {
-    DBUGLN("Rotating log file");
+    size_t length = eventFile.size();
+    uint8_t *data = new uint8_t[length];
+    bool valid = length == eventFile.read(data, length) &&
+                 EventLogCodec::decompress(data, length, callback);
+    delete[] data;
     eventFile.close();
 
-    _max_log_index ++;
-    eventFilename = filenameFromIndex(_max_log_index);
-    eventFile = LittleFS.open(eventFilename, FILE_APPEND);
+    if(!valid) {
+      DBUGF("Block %d is corrupt", index);
+    }
+    return valid;
+  }
 
-    // _max_log_index is inclusive, so we need to increment it here
-    while((_max_log_index + 1) - _min_log_index > EVENTLOG_MAX_ROTATE_COUNT) {
-      LittleFS.remove(filenameFromIndex(_min_log_index));
-      _min_log_index++;
+  EventLogEntry entry;
+  while(sizeof(entry) == eventFile.read((uint8_t *)&entry, sizeof(entry)))
+  {
+    if(!entry.isValid()) {
+      DBUGF("Skipping corrupt event at %d", eventFile.position() - sizeof(entry));
+      continue;
     }
+
+    callback(entry);
   }
+  eventFile.close();
 
+  return true;
+}
+
+void EventLog::indexBlock(uint32_t index)
+{
+  EventLogBlockInfo &info = blockInfo(index);
+  info = EventLogBlockInfo();
+
+  File eventFile = LittleFS.open(filenameFromIndex(index));
   if(eventFile)
   {
-    StaticJsonDocument<256> line;
-    char output[80];
-    strftime(output, 80, "%FT%TZ", &timeinfo);
-
-    line["t"] = output;
-    line["ty"] = type.toInt();
-    line["ms"] = managerState.toString();
-    line["es"] = evseState;
-    line["ef"] = evseFlags;
-    line["p"] = pilot;
-    line["e"] = energy;
-    line["el"] = elapsed;
-    line["tp"] = temperature;
-    line["tm"] = temperatureMax;
-    line["dm"] = divertMode;
-    line["sh"] = shaper;
-
-    serializeJson(line, eventFile);
-    eventFile.println("");
-
-    #ifdef ENABLE_DEBUG
-    serializeJson(line, DEBUG_PORT);
-    DBUGLN("");
-    #endif
-
+    info.size = eventFile.size();
+    info.compressed = EVENTLOG_COMPRESSED_VERSION == eventFile.peek();
     eventFile.close();
+
+    readBlock(index, [&info](const EventLogEntry &entry) {
+      info.add(entry);
+    });
   }
+
+  DBUGF("Block %d: %d events %d-%d, types %x, %d bytes%s", index, info.count, info.start, info.end, info.types, info.size, info.compressed ? " compressed" : "");
 }
 
-void EventLog::enumerate(uint32_t index, std::function<void(String time, EventType type, const String &logEntry, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper)> callback)
+void EventLog::compressBlock(uint32_t index)
 {
+  EventLogBlockInfo &info = blockInfo(index);
+  if(info.compressed || 0 == info.count) {
+    return;
+  }
+
   String filename = filenameFromIndex(index);
   File eventFile = LittleFS.open(filename);
-  if(eventFile)
+  if(!eventFile) {
+    return;
+  }
+
+  size_t size = eventFile.size();
+  size_t count = 0;
+  EventLogEntry *entries = new EventLogEntry[size / sizeof(EventLogEntry)];
+  while(count < size / sizeof(EventLogEntry) &&
+        sizeof(EventLogEntry) == eventFile.read((uint8_t *)&entries[count], sizeof(EventLogEntry)))
   {
-    while(eventFile.available())
-    {
-      String line = eventFile.readStringUntil('\n');
-      if(line.length() > 0)
-      {
-        StaticJsonDocument<256> json;
-        DeserializationError error = deserializeJson(json, line);
-        if(error)
-        {
-          DBUGF("Error parsing line: %s", error.c_str());
-          break;
-        }
+    if(entries[count].isValid()) {
+      count++;
+    }
+  }
+  eventFile.close();
 
-        String time = json["t"];
-        EventType type = EventType::Information;
-        type.fromInt(json["ty"]);
-        EvseState managerState = EvseState::None;
-        managerState.fromString(json["ms"]);
-        uint8_t evseState = json["es"];
-        uint32_t evseFlags = json["ef"];
-        uint32_t pilot = json["p"];
-        double energy = json["e"];
-        uint32_t elapsed = json["el"];
-        double temperature = json["tp"];
-        double temperatureMax = json["tm"];
-        uint8_t divertMode = json["dm"];
-        uint8_t shaper = json["sh"];
-
-        callback(time, type, line, managerState, evseState, evseFlags, pilot, energy, elapsed, temperature, temperatureMax, divertMode, shaper);
-      }
+  uint8_t *buffer = new uint8_t[size];
+  size_t length = EventLogCodec::compress(entries, count, buffer, size);
+  delete[] entries;
+
+  // Written to a temporary file and renamed so there is always a complete copy
+  if(length > 0)
+  {
+    File tempFile = LittleFS.open(EVENTLOG_TEMP_FILE, FILE_WRITE);
+    bool written = tempFile && length == tempFile.write(buffer, length);
+    if(tempFile) {
+      tempFile.close();
     }
+
+    if(written && LittleFS.rename(EVENTLOG_TEMP_FILE, filename))
+    {
+      DBUGF("Compressed block %d from %d to %d bytes", index, size, length);
+      info.compressed = true;
+      info.size = length;
+    } else {
+      LittleFS.remove(EVENTLOG_TEMP_FILE);
+    }
+  }
+  delete[] buffer;
+}
+
+// Rewrite a block logged as JSON lines by older firmware as EventLogEntry
+// records, returns false if the block is already in the current format
+bool EventLog::convertBlock(uint32_t index)
+{
+  String filename = filenameFromIndex(index);
+  File eventFile = LittleFS.open(filename);
+  if(!eventFile) {
+    return false;
+  }
+
+  int first = eventFile.peek();
+  if(0 == eventFile.size() || EVENTLOG_RECORD_VERSION == first || EVENTLOG_COMPRESSED_VERSION == first) {
     eventFile.close();
+    return false;
+  }
+
+  // Written to a temporary file and renamed so there is always a complete copy
+  File tempFile = LittleFS.open(EVENTLOG_TEMP_FILE, FILE_WRITE);
+  bool written = (bool)tempFile;
+  size_t count = 0;
+  while(written && eventFile.available())
+  {
+    String line = eventFile.readStringUntil('\n');
+    StaticJsonDocument<256> json;
+    if(0 == line.length() || deserializeJson(json, line)) {
+      continue;
+    }
+
+    int year, month, day, hour, minute, second;
+    if(6 != sscanf(json["t"] | "", "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second)) {
+      continue;
+    }
+
+    EventType type = EventType::Information;
+    type.fromInt(json["ty"]);
+    EvseState managerState = EvseState::None;
+    managerState.fromString(json["ms"] | "");
+
+    EventLogEntry entry;
+    entry.type = type.toInt();
+    entry.managerState = (EvseState::Value)managerState;
+    entry.evseState = json["es"];
+    entry.time = EventLogEntry::timeFromCivil(year, month, day, hour, minute, second);
+    entry.evseFlags = json["ef"];
+    entry.pilot = json["p"];
+    entry.energy = json["e"];
+    entry.elapsed = json["el"];
+    entry.temperature = temperatureToInt(json["tp"]);
+    entry.temperatureMax = temperatureToInt(json["tm"]);
+    entry.divertMode = json["dm"];
+    entry.shaper = json["sh"];
+    entry.seal();
+
+    written = sizeof(entry) == tempFile.write((const uint8_t *)&entry, sizeof(entry));
+    count++;
+  }
+  eventFile.close();
+  if(tempFile) {
+    tempFile.close();
+  }
+
+  if(written && LittleFS.rename(EVENTLOG_TEMP_FILE, filename))
+  {
+    DBUGF("Converted %d events in block %d", count, index);
+    return true;
+  }
+
+  LittleFS.remove(EVENTLOG_TEMP_FILE);
+  return false;
+}
+
+void EventLog::removeOldest()
+{
+  LittleFS.remove(filenameFromIndex(_min_log_index));
+  blockInfo(_min_log_index) = EventLogBlockInfo();
+  _min_log_index++;
+}
+
+// Remove the oldest blocks until the log, with room for the newest block to
+// fill, fits in EVENTLOG_BUDGET
+void EventLog::trim()
+{
+  uint32_t total = EVENTLOG_ROTATE_SIZE;
+  for(uint32_t index = _min_log_index; index < _max_log_index; index++) {
+    total += blockInfo(index).size;
+  }
+
+  while(_min_log_index < _max_log_index && total > EVENTLOG_BUDGET)
+  {
+    total -= blockInfo(_min_log_index).size;
+    removeOldest();
+  }
+}
+
+// Start a new block, compressing the one before
+void EventLog::rotate()
+{
+  DBUGLN("Rotating log file");
+
+  _max_log_index ++;
+
+  // _max_log_index is inclusive, so we need to increment it here
+  while((_max_log_index + 1) - _min_log_index > EVENTLOG_MAX_BLOCKS) {
+    removeOldest();
+  }
+  blockInfo(_max_log_index) = EventLogBlockInfo();
+
+  compressBlock(_max_log_index - 1);
+  trim();
+  saveManifest();
+}
+
+bool EventLog::getBlockInfo(uint32_t index, EventLogBlockInfo &info)
+{
+  if(index < _min_log_index || index > _max_log_index) {
+    return false;
+  }
+
+  if(_buffered > 0) {
+    flush();
+  }
+
+  info = blockInfo(index);
+  return true;
+}
+
+void EventLog::query(uint32_t from, uint32_t to, uint8_t typeMask, std::function<void(const EventLogEntry &entry)> callback)
+{
+  if(_buffered > 0) {
+    flush();
+  }
+
+  for(uint32_t index = _min_log_index; index <= _max_log_index; index++)
+  {
+    if(!blockInfo(index).matches(from, to, typeMask)) {
+      continue;
+    }
+
+    enumerate(index, [from, to, typeMask, &callback](const EventLogEntry &entry)
+    {
+      if(entry.time >= from && entry.time <= to && (typeMask & EVENTLOG_TYPE_MASK(entry.type))) {
+        callback(entry);
+      }
+    });
   }
 }
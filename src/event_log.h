@@ -2,20 +2,48 @@
 #define __EVENT_LOG_H
 
 #include <Arduino.h>
+#include <MicroTasks.h>
 #include "evse_state.h"
 
 #ifndef EVENTLOG_ROTATE_SIZE
 #define EVENTLOG_ROTATE_SIZE        1024
 #endif
 
-#ifndef EVENTLOG_MAX_ROTATE_COUNT
-#define EVENTLOG_MAX_ROTATE_COUNT   10
+// The flash used by the log, once the blocks add up to more than this the oldest
+// are removed. Blocks are compressed when they are rotated, so this holds around
+// three times as many events as it would uncompressed.
+#ifndef EVENTLOG_BUDGET
+#define EVENTLOG_BUDGET             (10 * 1024)
+#endif
+
+// The most blocks kept, each has an EventLogBlockInfo in RAM
+#ifndef EVENTLOG_MAX_BLOCKS
+#define EVENTLOG_MAX_BLOCKS         64
 #endif
 
 #ifndef EVENTLOG_BASE_DIRECTORY
 #define EVENTLOG_BASE_DIRECTORY     "/eventlog"
 #endif
 
+// Events are held in RAM and written to flash when this many are waiting, ...
+#ifndef EVENTLOG_BUFFER_COUNT
+#define EVENTLOG_BUFFER_COUNT       8
+#endif
+
+// ... or the first has been waiting this long (ms)
+#ifndef EVENTLOG_FLUSH_TIME
+#define EVENTLOG_FLUSH_TIME         (5 * 60 * 1000)
+#endif
+
+// The block range and index, saved on rotation so begin() does not have to scan
+// the directory and read every block
+#ifndef EVENTLOG_MANIFEST_FILE
+#define EVENTLOG_MANIFEST_FILE      "/eventlog.manifest"
+#endif
+
+#define EVENTLOG_RECORD_VERSION     1
+#define EVENTLOG_MANIFEST_VERSION   2
+
 class EventType
 {
   public:
@@ -61,21 +89,136 @@ class EventType
     Value _value;
 };
 
-class EventLog
+// The on-flash format of an event, a block file is a sequence of these. The
+// version and CRC let a damaged or foreign record be skipped without losing the
+// rest of the block.
+struct __attribute__((packed)) EventLogEntry
+{
+  uint8_t version;
+  uint8_t type;
+  uint8_t managerState;
+  uint8_t evseState;
+  uint32_t time;
+  uint32_t evseFlags;
+  uint16_t pilot;
+  // Session energy (Wh) and elapsed time (s)
+  float energy;
+  uint32_t elapsed;
+  // 0.1 C
+  int16_t temperature;
+  int16_t temperatureMax;
+  uint8_t divertMode;
+  uint8_t shaper;
+  uint16_t crc;
+
+  // Fill in the version and CRC
+  void seal();
+  bool isValid() const;
+
+  EventType getType() const {
+    EventType value = EventType::Information;
+    value.fromInt(type);
+    return value;
+  }
+
+  EvseState getManagerState() const {
+    return (EvseState::Value)managerState;
+  }
+
+  double getTemperature() const {
+    return temperature / 10.0;
+  }
+
+  double getTemperatureMax() const {
+    return temperatureMax / 10.0;
+  }
+
+  // Format the time as ISO 8601, eg 2023-01-01T12:00:00Z
+  size_t formatTime(char *buffer, size_t size) const;
+
+  // Epoch seconds of a UTC date and time in the proleptic Gregorian calendar
+  static uint32_t timeFromCivil(int year, unsigned month, unsigned day, unsigned hour = 0, unsigned minute = 0, unsigned second = 0);
+
+  static uint16_t calculateCrc(const uint8_t *data, size_t length, uint16_t crc = 0xffff);
+};
+
+#define EVENTLOG_TYPE_MASK(type) (1 << (type))
+#define EVENTLOG_TYPES_ALL ((1 << (EventType::Warning + 1)) - 1)
+
+// A summary of the events in a block, so a query only reads the blocks that can
+// have matching events
+struct EventLogBlockInfo
+{
+  // The earliest and latest event times, the events are not guaranteed to be in
+  // order if the clock has been changed
+  uint32_t start;
+  uint32_t end;
+  // Bytes used on flash
+  uint32_t size;
+  uint16_t count;
+  // EVENTLOG_TYPE_MASK() of each type in the block
+  uint8_t types;
+  bool compressed;
+
+  void add(const EventLogEntry &entry);
+
+  bool matches(uint32_t from, uint32_t to, uint8_t typeMask) const {
+    return count > 0 && start <= to && end >= from && (types & typeMask);
+  }
+};
+
+// Events are buffered and written from the EventLog task, so the EVSE loop
+// logging them does not wait on the flash. Warnings and changes of the manager
+// state are written straight after they are logged, everything else when the
+// buffer is full or EVENTLOG_FLUSH_TIME has passed.
+//
+// The newest block is a sequence of EventLogEntry, older blocks are compressed
+// with EventLogCodec and decompressed as they are read.
+class EventLog : public MicroTasks::Task
 {
 private:
   uint32_t _min_log_index;
   uint32_t _max_log_index;
 
+  EventLogBlockInfo _blocks[EVENTLOG_MAX_BLOCKS];
+
+  EventLogEntry _buffer[EVENTLOG_BUFFER_COUNT];
+  uint8_t _buffered;
+  unsigned long _firstBuffered;
+  bool _urgent;
+  uint8_t _lastManagerState;
+  bool _running;
+
   String filenameFromIndex(uint32_t index);
   uint32_t indexFromFilename(String &filename);
 
+  EventLogBlockInfo &blockInfo(uint32_t index) {
+    return _blocks[index % EVENTLOG_MAX_BLOCKS];
+  }
+  void indexBlock(uint32_t index);
+  bool readBlock(uint32_t index, std::function<void(const EventLogEntry &entry)> callback);
+  void compressBlock(uint32_t index);
+  bool convertBlock(uint32_t index);
+  void removeOldest();
+  void trim();
+  void rotate();
+  void scan();
+  bool loadManifest();
+  void saveManifest();
+
+protected:
+  void setup();
+  unsigned long loop(MicroTasks::WakeReason reason);
+
 public:
   EventLog();
   ~EventLog();
 
   void begin();
 
+  // Write any buffered events to flash, eg before restarting
+  void flush();
+
   uint32_t getMinIndex() {
     return _min_log_index;
   }
@@ -85,7 +228,12 @@ public:
   }
 
   void log(EventType type, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper);
-  void enumerate(uint32_t index, std::function<void(String time, EventType type, const String &logEntry, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper)> callback);
+  void enumerate(uint32_t index, std::function<void(const EventLogEntry &entry)> callback);
+
+  // The events from..to (epoch seconds, inclusive) of the types in typeMask
+  void query(uint32_t from, uint32_t to, uint8_t typeMask, std::function<void(const EventLogEntry &entry)> callback);
+
+  bool getBlockInfo(uint32_t index, EventLogBlockInfo &info);
 };
 
 
@@ -0,0 +1,263 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_EVENT_LOG)
+#undef ENABLE_DEBUG
+#endif
+
+#include "event_log_codec.h"
+#include "debug.h"
+
+// The state fields stored at the start of a run if they differ from the last run
+#define STATE_TYPE          (1 << 0)
+#define STATE_MANAGER_STATE (1 << 1)
+#define STATE_EVSE_STATE    (1 << 2)
+#define STATE_EVSE_FLAGS    (1 << 3)
+#define STATE_PILOT         (1 << 4)
+#define STATE_DIVERT_MODE   (1 << 5)
+#define STATE_SHAPER        (1 << 6)
+
+namespace {
+
+class BlockWriter
+{
+  private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+
+  public:
+    BlockWriter(uint8_t *buffer, size_t size) :
+      _buffer(buffer), _size(size), _length(0) {
+    }
+
+    void byte(uint8_t value)
+    {
+      if(_length < _size) {
+        _buffer[_length] = value;
+      }
+      _length++;
+    }
+
+    // LEB128
+    void varint(uint32_t value)
+    {
+      while(value >= 0x80) {
+        byte((value & 0x7f) | 0x80);
+        value >>= 7;
+      }
+      byte(value);
+    }
+
+    // Zig-zag encoded so small negative changes are small
+    void delta(int32_t value) {
+      varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+
+    bool overflow() {
+      return _length > _size;
+    }
+
+    size_t length() {
+      return _length;
+    }
+};
+
+class BlockReader
+{
+  private:
+    const uint8_t *_data;
+    size_t _length;
+    size_t _pos;
+    bool _error;
+
+  public:
+    BlockReader(const uint8_t *data, size_t length) :
+      _data(data), _length(length), _pos(0), _error(false) {
+    }
+
+    uint8_t byte()
+    {
+      if(_pos < _length) {
+        return _data[_pos++];
+      }
+      _error = true;
+      return 0;
+    }
+
+    uint32_t varint()
+    {
+      uint32_t value = 0;
+      for(int shift = 0; shift < 35; shift += 7)
+      {
+        uint8_t b = byte();
+        value |= (uint32_t)(b & 0x7f) << shift;
+        if(0 == (b & 0x80)) {
+          return value;
+        }
+      }
+      _error = true;
+      return 0;
+    }
+
+    int32_t delta() {
+      uint32_t value = varint();
+      return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    bool error() {
+      return _error;
+    }
+
+    bool done() {
+      return _pos == _length;
+    }
+};
+
+} // namespace
+
+static uint32_t energyBits(float energy)
+{
+  uint32_t bits;
+  memcpy(&bits, &energy, sizeof(bits));
+  return bits;
+}
+
+static float energyFromBits(uint32_t bits)
+{
+  float energy;
+  memcpy(&energy, &bits, sizeof(energy));
+  return energy;
+}
+
+static bool sameState(const EventLogEntry &a, const EventLogEntry &b)
+{
+  return a.type == b.type &&
+         a.managerState == b.managerState &&
+         a.evseState == b.evseState &&
+         a.evseFlags == b.evseFlags &&
+         a.pilot == b.pilot &&
+         a.divertMode == b.divertMode &&
+         a.shaper == b.shaper;
+}
+
+size_t EventLogCodec::compress(const EventLogEntry *entries, size_t count, uint8_t *buffer, size_t size)
+{
+  BlockWriter out(buffer, size);
+  out.byte(EVENTLOG_COMPRESSED_VERSION);
+  out.varint(count);
+
+  EventLogEntry last = {};
+  for(size_t start = 0; start < count; )
+  {
+    const EventLogEntry &state = entries[start];
+
+    size_t run = 1;
+    while(start + run < count && sameState(state, entries[start + run])) {
+      run++;
+    }
+
+    uint8_t changed =
+      (state.type != last.type ? STATE_TYPE : 0) |
+      (state.managerState != last.managerState ? STATE_MANAGER_STATE : 0) |
+      (state.evseState != last.evseState ? STATE_EVSE_STATE : 0) |
+      (state.evseFlags != last.evseFlags ? STATE_EVSE_FLAGS : 0) |
+      (state.pilot != last.pilot ? STATE_PILOT : 0) |
+      (state.divertMode != last.divertMode ? STATE_DIVERT_MODE : 0) |
+      (state.shaper != last.shaper ? STATE_SHAPER : 0);
+
+    out.byte(changed);
+    if(changed & STATE_TYPE) { out.byte(state.type); }
+    if(changed & STATE_MANAGER_STATE) { out.byte(state.managerState); }
+    if(changed & STATE_EVSE_STATE) { out.byte(state.evseState); }
+    if(changed & STATE_EVSE_FLAGS) { out.varint(state.evseFlags); }
+    if(changed & STATE_PILOT) { out.varint(state.pilot); }
+    if(changed & STATE_DIVERT_MODE) { out.byte(state.divertMode); }
+    if(changed & STATE_SHAPER) { out.byte(state.shaper); }
+    out.varint(run);
+
+    for(size_t i = start; i < start + run; i++)
+    {
+      const EventLogEntry &entry = entries[i];
+      out.delta(entry.time - last.time);
+      out.delta(energyBits(entry.energy) - energyBits(last.energy));
+      out.delta(entry.elapsed - last.elapsed);
+      out.delta(entry.temperature - last.temperature);
+      out.delta(entry.temperatureMax - last.temperatureMax);
+      last = entry;
+    }
+
+    start += run;
+  }
+
+  // The block ran past the end of buffer, so there is nothing complete to CRC
+  if(out.overflow()) {
+    return 0;
+  }
+
+  uint16_t crc = EventLogEntry::calculateCrc(buffer, out.length());
+  out.byte(crc & 0xff);
+  out.byte(crc >> 8);
+
+  return out.overflow() ? 0 : out.length();
+}
+
+bool EventLogCodec::decompress(const uint8_t *data, size_t length, std::function<void(const EventLogEntry &entry)> callback)
+{
+  if(length < 3 || EVENTLOG_COMPRESSED_VERSION != data[0]) {
+    return false;
+  }
+
+  uint16_t crc = data[length - 2] | (data[length - 1] << 8);
+  if(crc != EventLogEntry::calculateCrc(data, length - 2)) {
+    DBUGLN("Compressed block CRC error");
+    return false;
+  }
+
+  // Decode twice, the first time to check the block is well formed so a
+  // corrupt block does not give a partial list
+  for(int pass = 0; pass < 2; pass++)
+  {
+    BlockReader in(data + 1, length - 3);
+    uint32_t count = in.varint();
+
+    EventLogEntry entry = {};
+    uint32_t decoded = 0;
+    while(decoded < count && !in.error())
+    {
+      uint8_t changed = in.byte();
+      if(changed & STATE_TYPE) { entry.type = in.byte(); }
+      if(changed & STATE_MANAGER_STATE) { entry.managerState = in.byte(); }
+      if(changed & STATE_EVSE_STATE) { entry.evseState = in.byte(); }
+      if(changed & STATE_EVSE_FLAGS) { entry.evseFlags = in.varint(); }
+      if(changed & STATE_PILOT) { entry.pilot = in.varint(); }
+      if(changed & STATE_DIVERT_MODE) { entry.divertMode = in.byte(); }
+      if(changed & STATE_SHAPER) { entry.shaper = in.byte(); }
+
+      uint32_t run = in.varint();
+      if(0 == run || run > count - decoded) {
+        return false;
+      }
+
+      for(uint32_t i = 0; i < run && !in.error(); i++)
+      {
+        entry.time += in.delta();
+        entry.energy = energyFromBits(energyBits(entry.energy) + in.delta());
+        entry.elapsed += in.delta();
+        entry.temperature += in.delta();
+        entry.temperatureMax += in.delta();
+
+        if(1 == pass)
+        {
+          entry.seal();
+          callback(entry);
+        }
+      }
+
+      decoded += run;
+    }
+
+    if(in.error() || !in.done() || decoded != count) {
+      return false;
+    }
+  }
+
+  return true;
+}
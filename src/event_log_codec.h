@@ -0,0 +1,30 @@
+#ifndef __EVENT_LOG_CODEC_H
+#define __EVENT_LOG_CODEC_H
+
+#include <Arduino.h>
+#include "event_log.h"
+
+// The first byte of a compressed block, distinct from EVENTLOG_RECORD_VERSION
+#define EVENTLOG_COMPRESSED_VERSION 0x81
+
+// Compresses a block of EventLogEntry for long term storage.
+//
+// Consecutive entries with the same type, states, flags, pilot, divert mode and
+// shaper state are stored as one run, the state is only stored when it changes.
+// Each entry in a run stores the change in time, energy, elapsed time and
+// temperatures from the previous entry as variable length integers. Decoding
+// gives back the original entries exactly.
+//
+// Format: version, entry count, runs, CRC-16 of everything before it
+class EventLogCodec
+{
+  public:
+    // Compress count entries into buffer, returns the length or 0 if it does not fit
+    static size_t compress(const EventLogEntry *entries, size_t count, uint8_t *buffer, size_t size);
+
+    // Decompress a block, returns false if it is corrupt, in which case none of
+    // the entries are passed to callback
+    static bool decompress(const uint8_t *data, size_t length, std::function<void(const EventLogEntry &entry)> callback);
+};
+
+#endif // !__EVENT_LOG_CODEC_H
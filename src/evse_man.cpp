@@ -8,9 +8,11 @@
 #include "debug.h"
 
 #include "event_log.h"
+#include "event_bus.h"
 #include "divert.h"
 #include "current_shaper.h"
 #include "manual.h"
+#include "task_clock.h"
 
 static EvseProperties nullProperties;
 
@@ -113,10 +115,11 @@ void EvseManager::Claim::release()
   _client = EvseClient_NULL;
 }
 
-EvseManager::EvseManager(Stream &port, EventLog &eventLog) :
+EvseManager::EvseManager(Stream &port, EventLog &eventLog, OpenEVSEClass &openevse) :
   MicroTasks::Task(),
   _sender(&port),
-  _monitor(OpenEVSE),
+  _openevse(openevse),
+  _monitor(openevse),
   _eventLog(eventLog),
   _clients(),
   _evseStateListener(this),
@@ -217,11 +220,8 @@ bool EvseManager::evaluateClaims(EvseProperties &properties)
       }
 
       if(claim.getClient() == EvseClient_OpenEVSE_Manual) {
-        const size_t capacity = JSON_OBJECT_SIZE(40) + 1024;
         // update manual_override event to socket & mqtt
-        DynamicJsonDocument event(capacity);
-        event["manual_override"] = 1;
-        event_send(event);
+        eventBus.setInt(EventField_ManualOverride, 1);
       }
     }
   }
@@ -324,17 +324,17 @@ unsigned long EvseManager::loop(MicroTasks::WakeReason reason)
        WakeReason_Manual == reason ? "WakeReason_Manual" :
        "UNKNOWN");
   DBUG(" connected: ");
-  DBUGLN(OpenEVSE.isConnected());
+  DBUGLN(_openevse.isConnected());
 
   DBUGVAR(getActiveState().toString());
   DBUGVAR(_monitor.getEvseState());
   DBUGVAR(_monitor.getPilotState());
 
   // If we are not connected yet try and connect to the EVSE module
-  if(!OpenEVSE.isConnected())
+  if(!_openevse.isConnected())
   {
     initialiseEvse();
-    return 10 * 1000;
+    return TASK_CLOCK_SCHEDULE(this, 10 * 1000);
   }
 
   DBUGVAR(_evseBootListener.IsTriggered());
@@ -391,7 +391,7 @@ unsigned long EvseManager::loop(MicroTasks::WakeReason reason)
     _evaluateTargetState = false;
     setTargetState(_targetProperties);
   }
-  return MicroTask.Infinate;
+  return TASK_CLOCK_SCHEDULE(this, MicroTask.Infinate);
 }
 
 bool EvseManager::begin()
@@ -427,12 +427,10 @@ bool EvseManager::claim(EvseClient client, int priority, EvseProperties &target)
       DBUGF("Claim added/updated, waking task");
       _evaluateClaims = true;
       MicroTask.wakeTask(this);
-      StaticJsonDocument<128> event;
-      event["claims_version"] = ++_version;
+      eventBus.setInt(EventField_ClaimsVersion, ++_version);
       if (client == EvseClient_OpenEVSE_Manual) {
-          event["override_version"] = manual.setVersion(manual.getVersion() + 1);
+          eventBus.setInt(EventField_OverrideVersion, manual.setVersion(manual.getVersion() + 1));
       }
-      event_send(event);
     }
     return true;
   }
@@ -448,21 +446,15 @@ bool EvseManager::release(EvseClient client)
   {
     // if claim is manual override, publish data to socket & mqtt
     if (claim->getClient() == EvseClient_OpenEVSE_Manual) {
-      const size_t capacity = JSON_OBJECT_SIZE(40) + 1024;
-      DynamicJsonDocument event(capacity);
-      event["manual_override"] = 0;
-      event_send(event);
+      eventBus.setInt(EventField_ManualOverride, 0);
     }
     claim->release();
     _evaluateClaims = true;
     MicroTask.wakeTask(this);
-    StaticJsonDocument<128> event;
-    event["claims_version"] = ++_version;
+    eventBus.setInt(EventField_ClaimsVersion, ++_version);
     if (client == EvseClient_OpenEVSE_Manual) {
-          event["override_version"] = manual.setVersion(manual.getVersion() + 1);
-
+          eventBus.setInt(EventField_OverrideVersion, manual.setVersion(manual.getVersion() + 1));
     }
-    event_send(event);
     return true;
   }
 
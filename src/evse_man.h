@@ -213,6 +213,7 @@ class EvseManager : public MicroTasks::Task
     };
 
     RapiSender _sender;
+    OpenEVSEClass &_openevse;
     EvseMonitor _monitor;
     EventLog &_eventLog;
 
@@ -258,7 +259,7 @@ class EvseManager : public MicroTasks::Task
     unsigned long loop(MicroTasks::WakeReason reason);
 
   public:
-    EvseManager(Stream &port, EventLog &eventLog);
+    EvseManager(Stream &port, EventLog &eventLog, OpenEVSEClass &openevse = OpenEVSE);
     ~EvseManager();
 
     bool begin();
@@ -279,7 +280,7 @@ class EvseManager : public MicroTasks::Task
 
     // Evse Status
     bool isConnected() {
-      return OpenEVSE.isConnected();
+      return _openevse.isConnected();
     }
     bool isActive() {
       return getActiveState() == EvseState::Active;
@@ -339,6 +340,9 @@ class EvseManager : public MicroTasks::Task
     double getTotalYear() {
       return _monitor.getTotalYear();
     }
+    uint32_t getTotalSwitches() {
+      return _monitor.getTotalSwitches();
+    }
     bool saveEnergyMeter() {
       return _monitor.saveEnergyMeter();
     }
@@ -501,7 +505,7 @@ class EvseManager : public MicroTasks::Task
 
     // Get the OpenEVSE API
     OpenEVSEClass &getOpenEVSE() {
-      return OpenEVSE;
+      return _openevse;
     }
 
     // Register for events
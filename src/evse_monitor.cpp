@@ -7,6 +7,8 @@
 #include "emonesp.h"
 #include "evse_monitor.h"
 #include "event.h"
+#include "event_bus.h"
+#include "task_clock.h"
 #include "debug.h"
 
 #ifdef ENABLE_MCP9808
@@ -18,11 +20,6 @@
 #endif
 #endif
 
-// Time between loop polls
-#ifndef EVSE_MONITOR_POLL_TIME
-#define EVSE_MONITOR_POLL_TIME 1000
-#endif // !EVSE_MONITOR_POLL_TIME
-
 // These poll times are in terms of number of EVSE_MONITOR_POLL_TIME
 
 #ifndef EVSE_MONITOR_STATE_TIME
@@ -356,7 +353,7 @@ unsigned long EvseMonitor::loop(MicroTasks::WakeReason reason)
 
   _count ++;
 
-  return EVSE_MONITOR_POLL_TIME;
+  return TASK_CLOCK_SCHEDULE(this, EVSE_MONITOR_POLL_TIME);
 }
 
 bool EvseMonitor::begin(RapiSender &sender)
@@ -433,7 +430,7 @@ void EvseMonitor::unlock()
 
 void EvseMonitor::enable()
 {
-  OpenEVSE.enable([this](int ret)
+  _openevse.enable([this](int ret)
   {
     DBUGF("EVSE: enable - complete %d", ret);
     if(RAPI_RESPONSE_OK == ret) {
@@ -446,7 +443,7 @@ void EvseMonitor::enable()
 
 void EvseMonitor::sleep()
 {
-  OpenEVSE.sleep([this](int ret)
+  _openevse.sleep([this](int ret)
   {
     DBUGF("EVSE: sleep - complete %d", ret);
     if(RAPI_RESPONSE_OK == ret) {
@@ -457,7 +454,7 @@ void EvseMonitor::sleep()
 
 void EvseMonitor::disable()
 {
-  OpenEVSE.disable([this](int ret)
+  _openevse.disable([this](int ret)
   {
     DBUGF("EVSE: disable - complete %d", ret);
     if(RAPI_RESPONSE_OK == ret) {
@@ -468,7 +465,7 @@ void EvseMonitor::disable()
 
 void EvseMonitor::restart()
 {
-  OpenEVSE.restart([this](int ret)
+  _openevse.restart([this](int ret)
   {
     DBUGF("EVSE: reboot - complete %d", ret);
     if(RAPI_RESPONSE_OK == ret) {
@@ -738,11 +735,9 @@ void EvseMonitor::getChargeCurrentAndVoltageFromEvse()
           _power = _power * 3;
         }
 
-        StaticJsonDocument<64> event;
-        event["amp"] = _amp * AMPS_SCALE_FACTOR;;
-        event["voltage"] = _voltage * VOLTS_SCALE_FACTOR;
-        event["power"] = _power * POWER_SCALE_FACTOR;
-        event_send(event);
+        eventBus.setDouble(EventField_Amp, _amp * AMPS_SCALE_FACTOR);
+        eventBus.setDouble(EventField_Voltage, _voltage * VOLTS_SCALE_FACTOR);
+        eventBus.setDouble(EventField_Power, _power * POWER_SCALE_FACTOR);
         _data_ready.ready(EVSE_MONITOR_AMP_AND_VOLT_DATA_READY);
       }
     });
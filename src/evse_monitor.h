@@ -20,6 +20,11 @@
 
 #define EVSE_MONITOR_TEMP_COUNT         6
 
+// Time between loop polls
+#ifndef EVSE_MONITOR_POLL_TIME
+#define EVSE_MONITOR_POLL_TIME 1000
+#endif // !EVSE_MONITOR_POLL_TIME
+
 class EvseMonitor : public MicroTasks::Task
 {
   private:
@@ -268,6 +273,9 @@ class EvseMonitor : public MicroTasks::Task
     double getTotalYear() {
       return _energyMeter.getYearly();
     }
+    uint32_t getTotalSwitches() {
+      return _energyMeter.getSwitches();
+    }
     bool saveEnergyMeter() {
       return _energyMeter.save();
     }
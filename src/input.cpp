@@ -11,6 +11,7 @@
 #include "app_config.h"
 #include "divert.h"
 #include "event.h"
+#include "event_bus.h"
 #include "net_manager.h"
 #include "openevse.h"
 #include "espal.h"
@@ -67,21 +68,18 @@ class InputTask : public MicroTasks::Task
       if(_evseState.IsTriggered())
       {
         // Send to all clients
-        StaticJsonDocument<512> event;
-        event["state"] = evse.getEvseState();
-        event["flags"] = evse.getFlags();
-        event["vehicle"] = evse.isVehicleConnected() ? 1 : 0;
-        event["colour"] = evse.getStateColour();
-        event["pilot"] = evse.getChargeCurrent();
-        event["max_current"] = evse.getMaxCurrent();
-        event["manual_override"] = manual.isActive() ? 1 : 0; //TODO: remove this
-        event["status"] = evse.getState().toString();
-        event["elapsed"] = evse.getSessionElapsed();
-        event["amp"] = evse.getAmps() * AMPS_SCALE_FACTOR;
-        event["voltage"] = evse.getVoltage() * VOLTS_SCALE_FACTOR;
-        event["power"] = evse.getPower() * POWER_SCALE_FACTOR;
-
-        event_send(event);
+        eventBus.setInt(EventField_State, evse.getEvseState());
+        eventBus.setInt(EventField_Flags, evse.getFlags());
+        eventBus.setInt(EventField_Vehicle, evse.isVehicleConnected() ? 1 : 0);
+        eventBus.setInt(EventField_Colour, evse.getStateColour());
+        eventBus.setInt(EventField_Pilot, evse.getChargeCurrent());
+        eventBus.setInt(EventField_MaxCurrent, evse.getMaxCurrent());
+        eventBus.setInt(EventField_ManualOverride, manual.isActive() ? 1 : 0); //TODO: remove this
+        eventBus.setString(EventField_Status, evse.getState().toString());
+        eventBus.setInt(EventField_Elapsed, evse.getSessionElapsed());
+        eventBus.setDouble(EventField_Amp, evse.getAmps() * AMPS_SCALE_FACTOR);
+        eventBus.setDouble(EventField_Voltage, evse.getVoltage() * VOLTS_SCALE_FACTOR);
+        eventBus.setDouble(EventField_Power, evse.getPower() * POWER_SCALE_FACTOR);
       }
 
       return MicroTask.Infinate;
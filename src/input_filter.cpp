@@ -5,41 +5,55 @@
 #include "input_filter.h"
 #include "debug.h"
 
+InputFilter::Factor InputFilter::_factorCache[INPUT_FILTER_FACTOR_CACHE_SIZE];
+
 InputFilter::InputFilter() {
   _last_data_time = 0;
 }
 
+// delta in ms, tau in sec
 double InputFilter::getFactor(uint32_t delta, uint32_t tau)
 {
-	double factor;
-	if (tau > 0)
+	if (0 == tau)
 	{
-		if (tau < INPUT_FILTER_MIN_TAU)
-		{
-			tau = INPUT_FILTER_MIN_TAU;
-		}
-		factor = 1 - exp((-1) * ((double)delta / (double)tau));
+		// avoid divide by 0 , tau 0 means no filtering
+		return 1;
 	}
-	else
+	if (0 == delta)
 	{
-		// avoid divide by 0 , tau 0 means no filtering
-		factor = 1;
+		return 0;
+	}
+	if (tau < INPUT_FILTER_MIN_TAU)
+	{
+		tau = INPUT_FILTER_MIN_TAU;
 	}
-  DBUGVAR(factor);
-  return factor;
+
+	Factor &cached = _factorCache[(delta * 31 + tau) % INPUT_FILTER_FACTOR_CACHE_SIZE];
+	if (cached.delta != delta || cached.tau != tau)
+	{
+		cached.delta = delta;
+		cached.tau = tau;
+		cached.factor = 1 - exp((-1) * ((double)delta / ((double)tau * 1000)));
+	}
+  DBUGVAR(cached.factor);
+  return cached.factor;
 }
 
-double InputFilter::filter(double input, double filtered, uint32_t tau)
+double InputFilter::filter(double input, double filtered, uint32_t tau, uint32_t timestamp)
 {
   if (!_last_data_time) {
-		_last_data_time = millis();
+		_last_data_time = timestamp;
+  }
+  // Samples measured before the last one add nothing
+  uint32_t delta = 0;
+  if ((int32_t)(timestamp - _last_data_time) > 0) {
+    delta = timestamp - _last_data_time;
+    _last_data_time = timestamp;
   }
-  uint32_t delta = (millis() - _last_data_time)/1000;
   DBUGVAR(delta);
   DBUGVAR(tau);
-  _last_data_time = millis();
   double factor = getFactor(delta, tau);
   filtered = ((input * factor) + (filtered * (1 - factor)));
   DBUGVAR(filtered);
   return filtered;
-}
\ No newline at end of file
+}
@@ -5,17 +5,31 @@
 #ifndef INPUT_FILTER_MIN_TAU
 #define INPUT_FILTER_MIN_TAU 10 // minimum tau constant in sec
 #endif
+
+// Number of (delta, tau) decay factors remembered, feeds at a steady rate only
+// need to calculate the factor once per tau
+#ifndef INPUT_FILTER_FACTOR_CACHE_SIZE
+#define INPUT_FILTER_FACTOR_CACHE_SIZE 8
+#endif
+
 #include <Arduino.h>
 
 class InputFilter {
   private:
-    long _last_data_time;
-    double getFactor(uint32_t delta, uint32_t tau);
+    struct Factor {
+      uint32_t delta;
+      uint32_t tau;
+      double factor;
+    };
+    static Factor _factorCache[INPUT_FILTER_FACTOR_CACHE_SIZE];
+
+    uint32_t _last_data_time;
+    static double getFactor(uint32_t delta, uint32_t tau);
 
   public:
     InputFilter();
-    // tau in sec
-    double filter(double input, double filtered, uint32_t tau);
+    // tau in sec, timestamp is the millis() the input was measured at
+    double filter(double input, double filtered, uint32_t tau, uint32_t timestamp);
 };
 
 #endif
@@ -48,6 +48,7 @@
 #include "time_man.h"
 #include "tesla_client.h"
 #include "event.h"
+#include "event_bus.h"
 #include "ocpp.h"
 #include "rfid.h"
 #include "current_shaper.h"
@@ -130,6 +131,16 @@ void setup()
   eventLog.begin();
   DBUGF("After eventLog.begin: %d", ESPAL.getFreeHeap());
 
+  // The status events are coalesced by the event bus, the web server and MQTT
+  // send the frame it serialised rather than each serialising the event
+  eventBus.onFlush([](const EventBusFrame &frame) {
+    web_server_event(frame.event, frame.json, frame.length);
+  });
+  eventBus.onFlush([](const EventBusFrame &frame) {
+    mqtt_publish(frame.event, frame.json, frame.length);
+  });
+  eventBus.begin();
+
   timeManager.begin();
   DBUGF("After timeManager.begin: %d", ESPAL.getFreeHeap());
 
@@ -285,13 +296,6 @@ loop() {
 } // end loop
 
 
-void event_send(String &json)
-{
-  StaticJsonDocument<512> event;
-  deserializeJson(event, json);
-  event_send(event);
-}
-
 void event_send(JsonDocument &event)
 {
   #ifdef ENABLE_DEBUG
@@ -317,6 +321,7 @@ class SystemRestart : public MicroTasks::Alarm
     {
       DBUGLN("Restarting...");
       evse.saveEnergyMeter();
+      eventLog.flush();
       net.wifiStop();
       ESPAL.reset();
     }
@@ -0,0 +1,69 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_METER_MAILBOX)
+#undef ENABLE_DEBUG
+#endif
+
+#include "meter_mailbox.h"
+#include "debug.h"
+
+MeterMailbox meterMailbox;
+
+MeterMailbox::MeterMailbox() :
+  _consumerCount(0)
+{
+  for(uint8_t i = 0; i < MeterInput_Count; i++)
+  {
+    _values[i].store(0);
+    _timestamps[i].store(0);
+  }
+  for(Consumer &consumer : _consumers)
+  {
+    consumer.task = NULL;
+    consumer.inputs = 0;
+    consumer.pending.store(0);
+  }
+}
+
+int MeterMailbox::subscribe(uint32_t inputs, MicroTasks::Task *task)
+{
+  uint8_t id = _consumerCount.load();
+  if(id >= METER_MAILBOX_MAX_CONSUMERS) {
+    return -1;
+  }
+
+  _consumers[id].task = task;
+  _consumers[id].inputs = inputs;
+  _consumers[id].pending.store(0);
+  _consumerCount.store(id + 1);
+  return id;
+}
+
+void MeterMailbox::store(MeterInput input, float value)
+{
+  _values[input].store(value);
+  _timestamps[input].store(millis());
+}
+
+void MeterMailbox::post(MeterInput input, float value)
+{
+  store(input, value);
+
+  uint32_t mask = METER_INPUT_MASK(input);
+  uint8_t count = _consumerCount.load();
+  for(uint8_t i = 0; i < count; i++)
+  {
+    Consumer &consumer = _consumers[i];
+    // Only the first sample since the consumer last ran needs to wake it
+    if((consumer.inputs & mask) && 0 == consumer.pending.fetch_or(mask)) {
+      MicroTask.wakeTask(consumer.task);
+    }
+  }
+}
+
+uint32_t MeterMailbox::take(int consumer)
+{
+  if(consumer < 0 || consumer >= _consumerCount.load()) {
+    return 0;
+  }
+
+  return _consumers[consumer].pending.exchange(0);
+}
@@ -0,0 +1,70 @@
+#ifndef _OPENEVSE_METER_MAILBOX_H
+#define _OPENEVSE_METER_MAILBOX_H
+
+#ifndef METER_MAILBOX_MAX_CONSUMERS
+#define METER_MAILBOX_MAX_CONSUMERS 4
+#endif
+
+#include <Arduino.h>
+#include <MicroTasks.h>
+#include <atomic>
+
+enum MeterInput : uint8_t
+{
+  MeterInput_Solar,
+  MeterInput_GridIe,
+  MeterInput_LivePwr,
+  MeterInput_Voltage,
+
+  MeterInput_Count
+};
+
+#define METER_INPUT_MASK(input) (1UL << (input))
+
+// Holds the latest sample of each of the meter inputs received over MQTT or HTTP.
+// Posting a sample only stores it and wakes the consumers, which pick up the newest
+// value the next time they run, so a burst of samples costs one calculation.
+class MeterMailbox
+{
+  private:
+    struct Consumer {
+      MicroTasks::Task *task;
+      uint32_t inputs;
+      std::atomic<uint32_t> pending;
+    };
+
+    std::atomic<float> _values[MeterInput_Count];
+    std::atomic<uint32_t> _timestamps[MeterInput_Count];
+
+    Consumer _consumers[METER_MAILBOX_MAX_CONSUMERS];
+    std::atomic<uint8_t> _consumerCount;
+
+  public:
+    MeterMailbox();
+
+    // Wake task when any of inputs is posted, returns the id passed to take() or
+    // -1 if there are too many consumers
+    int subscribe(uint32_t inputs, MicroTasks::Task *task);
+
+    void post(MeterInput input, float value);
+
+    // Store a sample without waking the consumers, for a caller that runs them
+    // itself (divert_sim)
+    void store(MeterInput input, float value);
+
+    // The inputs posted since the last call for this consumer
+    uint32_t take(int consumer);
+
+    float get(MeterInput input) {
+      return _values[input].load();
+    }
+
+    // The millis() the latest sample was posted at
+    uint32_t getTimestamp(MeterInput input) {
+      return _timestamps[input].load();
+    }
+};
+
+extern MeterMailbox meterMailbox;
+
+#endif // _OPENEVSE_METER_MAILBOX_H
@@ -14,6 +14,12 @@
 #include "manual.h"
 #include "scheduler.h"
 #include "certificates.h"
+#include "mqtt_publish_cache.h"
+#include "mqtt_topics.h"
+#include "mqtt_router.h"
+#include "mqtt_queue.h"
+#include "mqtt_publish_scheduler.h"
+#include "meter_mailbox.h"
 
 #include "openevse.h"
 #include "current_shaper.h"
@@ -29,6 +35,16 @@ EvseProperties claim_props;
 EvseProperties override_props;
 LimitProperties limit_props;
 DynamicJsonDocument mqtt_doc(4096);
+MqttPublishCache mqtt_publish_cache;
+MqttTopicTable mqtt_topics;
+MqttRouter mqtt_router;
+MqttQueue mqtt_queue;
+MqttPublishScheduler mqtt_scheduler;
+
+static mqtt_publish_format mqtt_format = MQTT_PUBLISH_FORMAT_TOPICS;
+static String mqtt_event_topic;
+static String mqtt_replay_topic;
+static uint8_t mqtt_publish_buffer[MQTT_PUBLISH_DOC_SIZE];
 
 static long nextMqttReconnectAttempt = 0;
 static unsigned long mqttRestartTime = 0;
@@ -38,6 +54,18 @@ uint8_t overrideVersion = 0;
 uint8_t scheduleVersion = 0;
 uint8_t limitVersion = 0;
 uint32_t configVersion = 0;
+unsigned long publishRefreshTime = 0;
+unsigned long queueDrainTime = 0;
+
+// The retained topics still to be republished after connecting
+#define MQTT_REPUBLISH_OVERRIDE (1 << 0)
+#define MQTT_REPUBLISH_CLAIM    (1 << 1)
+#define MQTT_REPUBLISH_SCHEDULE (1 << 2)
+#define MQTT_REPUBLISH_LIMIT    (1 << 3)
+#define MQTT_REPUBLISH_CONFIG   (1 << 4)
+#define MQTT_REPUBLISH_ALL      0x1f
+
+static uint8_t mqtt_republish = 0;
 
 String lastWill = "";
 
@@ -48,207 +76,271 @@ unsigned long error_time = 0;
 #define MQTT_CONNECT_TIMEOUT (5 * 1000)
 #endif // !MQTT_CONNECT_TIMEOUT
 
-// -------------------------------------------------------------------
-// MQTT msg Received callback function:
-// Function to be called when msg is received on MQTT subscribed topic
-// Used to receive RAPI commands via MQTT
-// //e.g to set current to 13A: <base-topic>/rapi/$SC 13
-// -------------------------------------------------------------------
-void mqttmsg_callback(MongooseString topic, MongooseString payload) {
+static void mqtt_on_solar(MongooseString payload)
+{
+  int solar = MqttRouter::toInt(payload);
+  DBUGF("solar:%dW", solar);
+  // divert and shaper are recalculated from their tasks
+  meterMailbox.post(MeterInput_Solar, solar);
+}
 
-  String topic_string = topic.toString();
-  // print received MQTT to debug
+static void mqtt_on_grid_ie(MongooseString payload)
+{
+  int grid_ie = MqttRouter::toInt(payload);
+  DBUGF("grid:%dW", grid_ie);
+  meterMailbox.post(MeterInput_GridIe, grid_ie);
 
-  DBUGLN("MQTT received:");
-  DBUGLN("Topic: " + topic_string);
+  // if shaper use the same topic as grid_ie
+  if (mqtt_live_pwr == mqtt_grid_ie) {
+    meterMailbox.post(MeterInput_LivePwr, grid_ie);
+  }
+}
 
-  String payload_str = payload.toString();
-  DBUGLN("Payload: " + payload_str);
+static void mqtt_on_live_pwr(MongooseString payload)
+{
+  meterMailbox.post(MeterInput_LivePwr, MqttRouter::toInt(payload));
+}
 
-  // If MQTT message is solar PV
-  if (topic_string == mqtt_solar){
-    solar = payload_str.toInt();
-    DBUGF("solar:%dW", solar);
-    divert.update_state();
-    //recalculate shaper
-    if (shaper.getState()) {
-      shaper.shapeCurrent();
-    }
-  }
-  else if (topic_string == mqtt_grid_ie)
-  {
-    grid_ie = payload_str.toInt();
-    DBUGF("grid:%dW", grid_ie);
-    divert.update_state();
+static void mqtt_on_vrms(MongooseString payload)
+{
+  // Applied to the EVSE by the divert task
+  meterMailbox.post(MeterInput_Voltage, MqttRouter::toFloat(payload));
+}
 
-    // if shaper use the same topic as grid_ie
-    if (mqtt_live_pwr == mqtt_grid_ie) {
-      shaper.setLivePwr(grid_ie);
-    }
-  }
-  else if (topic_string == mqtt_live_pwr)
-  {
-      shaper.setLivePwr(payload_str.toInt());
-      DBUGF("shaper: Live Pwr:%dW", shaper.getLivePwr());
+static void mqtt_on_vehicle_soc(MongooseString payload)
+{
+  if (vehicle_data_src != VEHICLE_DATA_SRC_MQTT) {
+    return;
   }
-  else if (topic_string == mqtt_vrms)
-  {
-    // TODO: The voltage is no longer a global, need to do something so we don't have
-    //       to read back from the EVSE
-    double volts = payload_str.toFloat();
-    DBUGF("voltage:%.1f", volts);
-    evse.setVoltage(volts);
+
+  int vehicle_soc = MqttRouter::toInt(payload);
+  DBUGF("vehicle_soc:%d%%", vehicle_soc);
+  evse.setVehicleStateOfCharge(vehicle_soc);
+
+  StaticJsonDocument<128> event;
+  event["battery_level"] = vehicle_soc;
+  event["vehicle_state_update"] = 0;
+  event_send(event);
+}
+
+static void mqtt_on_vehicle_range(MongooseString payload)
+{
+  if (vehicle_data_src != VEHICLE_DATA_SRC_MQTT) {
+    return;
   }
-  else if (topic_string == mqtt_vehicle_soc && vehicle_data_src == VEHICLE_DATA_SRC_MQTT)
-  {
-    int vehicle_soc = payload_str.toInt();
-    DBUGF("vehicle_soc:%d%%", vehicle_soc);
-    evse.setVehicleStateOfCharge(vehicle_soc);
 
-    StaticJsonDocument<128> event;
-    event["battery_level"] = vehicle_soc;
-    event["vehicle_state_update"] = 0;
-    event_send(event);
+  int vehicle_range = MqttRouter::toInt(payload);
+  DBUGF("vehicle_range:%dKM", vehicle_range);
+  evse.setVehicleRange(vehicle_range);
+
+  StaticJsonDocument<128> event;
+  event["battery_range"] = vehicle_range;
+  event["vehicle_state_update"] = 0;
+  event_send(event);
+}
+
+static void mqtt_on_vehicle_eta(MongooseString payload)
+{
+  if (vehicle_data_src != VEHICLE_DATA_SRC_MQTT) {
+    return;
   }
-  else if (topic_string == mqtt_vehicle_range && vehicle_data_src == VEHICLE_DATA_SRC_MQTT)
-  {
-    int vehicle_range = payload_str.toInt();
-    DBUGF("vehicle_range:%dKM", vehicle_range);
-    evse.setVehicleRange(vehicle_range);
 
-    StaticJsonDocument<128> event;
-    event["battery_range"] = vehicle_range;
-    event["vehicle_state_update"] = 0;
-    event_send(event);
+  int vehicle_eta = MqttRouter::toInt(payload);
+  DBUGF("vehicle_eta:%d", vehicle_eta);
+  evse.setVehicleEta(vehicle_eta);
+
+  StaticJsonDocument<128> event;
+  event["time_to_full_charge"] = vehicle_eta;
+  event["vehicle_state_update"] = 0;
+  event_send(event);
+}
+
+// Divert Mode
+static void mqtt_on_divertmode_set(MongooseString payload)
+{
+  byte newdivert = MqttRouter::toInt(payload);
+  if ((newdivert==1) || (newdivert==2)) {
+    divert.setMode((DivertMode)newdivert);
   }
-  else if (topic_string == mqtt_vehicle_eta && vehicle_data_src == VEHICLE_DATA_SRC_MQTT)
-  {
-    int vehicle_eta = payload_str.toInt();
-    DBUGF("vehicle_eta:%d", vehicle_eta);
-    evse.setVehicleEta(vehicle_eta);
+}
 
-    StaticJsonDocument<128> event;
-    event["time_to_full_charge"] = vehicle_eta;
-    event["vehicle_state_update"] = 0;
-    event_send(event);
+static void mqtt_on_shaper_set(MongooseString payload)
+{
+  byte newshaper = MqttRouter::toInt(payload);
+  if (newshaper==0) {
+    shaper.setState(false);
+  } else if (newshaper==1) {
+    shaper.setState(true);
   }
-  // Divert Mode
-  else if (topic_string == mqtt_topic + "/divertmode/set")
-  {
-    byte newdivert = payload_str.toInt();
-    if ((newdivert==1) || (newdivert==2)) {
-      divert.setMode((DivertMode)newdivert);
+}
+
+// Manual Override
+static void mqtt_on_override_set(MongooseString payload)
+{
+  if (payload.equals("clear")) {
+    if (manual.release()) {
+      override_props.clear();
+      mqtt_publish_override();
     }
   }
-  else if (topic_string == mqtt_topic + "/shaper/set")
-  {
-    byte newshaper = payload_str.toInt();
-    if (newshaper==0) {
-      shaper.setState(false);
-    } else if (newshaper==1) {
-      shaper.setState(true);
-    }
-  }
-  // Manual Override
-  else if (topic_string == mqtt_topic + "/override/set") {
-    if (payload_str.equals("clear")) {
-      if (manual.release()) {
-        override_props.clear();
-        mqtt_publish_override();
-      }
-    }
-    else if (payload_str.equals("toggle")) {
-      if (manual.toggle()) {
-        mqtt_publish_override();
-      }
+  else if (payload.equals("toggle")) {
+    if (manual.toggle()) {
+      mqtt_publish_override();
     }
-    else if (override_props.deserialize(payload_str)) {
+  }
+  else {
+    String json = payload.toString();
+    if (override_props.deserialize(json)) {
       mqtt_set_claim(true, override_props);
-      }
+    }
   }
+}
 
-  // Claim
-  else if (topic_string == mqtt_topic + "/claim/set") {
-    if (payload_str.equals("release")) {
-      if(evse.release(EvseClient_OpenEVSE_MQTT)) {
-        claim_props.clear();
-        mqtt_publish_claim();
-      }
+// Claim
+static void mqtt_on_claim_set(MongooseString payload)
+{
+  if (payload.equals("release")) {
+    if(evse.release(EvseClient_OpenEVSE_MQTT)) {
+      claim_props.clear();
+      mqtt_publish_claim();
     }
-    else if (claim_props.deserialize(payload_str)) {
+  }
+  else {
+    String json = payload.toString();
+    if (claim_props.deserialize(json)) {
       mqtt_set_claim(false, claim_props);
     }
   }
+}
 
-  //Schedule
-  else if (topic_string == mqtt_topic + "/schedule/set") {
-    mqtt_set_schedule(payload_str);
-  }
-  else if (topic_string == mqtt_topic + "/schedule/clear") {
-    mqtt_clear_schedule(payload_str.toInt());
-  }
+//Schedule
+static void mqtt_on_schedule_set(MongooseString payload)
+{
+  mqtt_set_schedule(payload.toString());
+}
 
-  else if (topic_string == mqtt_topic + "/limit/set") {
-    if (payload_str.equals("clear")) {
-      DBUGLN("clearing limits");
-      limit.clear();
-    }
-    else if (limit_props.deserialize(payload_str)) {
+static void mqtt_on_schedule_clear(MongooseString payload)
+{
+  mqtt_clear_schedule(MqttRouter::toInt(payload));
+}
+
+static void mqtt_on_limit_set(MongooseString payload)
+{
+  if (payload.equals("clear")) {
+    DBUGLN("clearing limits");
+    limit.clear();
+  }
+  else {
+    String json = payload.toString();
+    if (limit_props.deserialize(json)) {
       mqtt_set_limit(limit_props);
     }
   }
+}
 
-  else if (topic_string == mqtt_topic + "/config/set") {
-    const size_t capacity = JSON_OBJECT_SIZE(128) + 1024;
-    DynamicJsonDocument doc(capacity);
-    DeserializationError error = deserializeJson(doc, payload_str);
-    if(!error)
+static void mqtt_on_config_set(MongooseString payload)
+{
+  const size_t capacity = JSON_OBJECT_SIZE(128) + 1024;
+  DynamicJsonDocument doc(capacity);
+  DeserializationError error = deserializeJson(doc, payload.c_str(), payload.length());
+  if(!error)
+  {
+    bool config_modified = config_deserialize(doc);
+    if(config_modified)
     {
-      bool config_modified = config_deserialize(doc);
-      if(config_modified)
-      {
-        config_commit(false);
-        DBUGLN("Config updated");
-      }
+      config_commit(false);
+      DBUGLN("Config updated");
     }
   }
+}
+
+// Restart
+static void mqtt_on_restart(MongooseString payload)
+{
+  mqtt_restart_device(payload.toString());
+}
+
+// A queued message sent back by the broker, confirming it has been published
+static void mqtt_on_replay(MongooseString payload)
+{
+  mqtt_queue.ack(MqttPublishCache::hash(payload.c_str(), payload.length()));
+}
+
+// -------------------------------------------------------------------
+// Build the table of topics handled by mqttmsg_callback(), the first topic
+// routed wins if several are configured the same
+// -------------------------------------------------------------------
+static void mqtt_build_routes()
+{
+  mqtt_router.clear();
+
+  mqtt_router.on(mqtt_solar, mqtt_on_solar);
+  mqtt_router.on(mqtt_grid_ie, mqtt_on_grid_ie);
+  mqtt_router.on(mqtt_live_pwr, mqtt_on_live_pwr);
+  mqtt_router.on(mqtt_vrms, mqtt_on_vrms);
+  mqtt_router.on(mqtt_vehicle_soc, mqtt_on_vehicle_soc);
+  mqtt_router.on(mqtt_vehicle_range, mqtt_on_vehicle_range);
+  mqtt_router.on(mqtt_vehicle_eta, mqtt_on_vehicle_eta);
+
+  mqtt_router.on(mqtt_topic + "/divertmode/set", mqtt_on_divertmode_set);
+  mqtt_router.on(mqtt_topic + "/shaper/set", mqtt_on_shaper_set);
+  mqtt_router.on(mqtt_topic + "/override/set", mqtt_on_override_set);
+  mqtt_router.on(mqtt_topic + "/claim/set", mqtt_on_claim_set);
+  mqtt_router.on(mqtt_topic + "/schedule/set", mqtt_on_schedule_set);
+  mqtt_router.on(mqtt_topic + "/schedule/clear", mqtt_on_schedule_clear);
+  mqtt_router.on(mqtt_topic + "/limit/set", mqtt_on_limit_set);
+  mqtt_router.on(mqtt_topic + "/config/set", mqtt_on_config_set);
+  mqtt_router.on(mqtt_topic + "/restart", mqtt_on_restart);
+  mqtt_router.on(mqtt_topic + "/replay", mqtt_on_replay);
+}
+
+// -------------------------------------------------------------------
+// MQTT msg Received callback function:
+// Function to be called when msg is received on MQTT subscribed topic
+// Used to receive RAPI commands via MQTT
+// //e.g to set current to 13A: <base-topic>/rapi/$SC 13
+// -------------------------------------------------------------------
+void mqttmsg_callback(MongooseString topic, MongooseString payload) {
 
-  // Restart
-  else if (topic_string == mqtt_topic + "/restart") {
-    mqtt_restart_device(payload_str);
+  // print received MQTT to debug
+  DBUGLN("MQTT received:");
+  DBUGF("Topic: %.*s", topic.length(), topic.c_str());
+  DBUGF("Payload: %.*s", payload.length(), payload.c_str());
+
+  if(mqtt_router.dispatch(topic, payload)) {
+    return;
   }
 
-  else
-  {
-    // If MQTT message is RAPI command
-    // Detect if MQTT message is a RAPI command e.g to set 13A <base-topic>/rapi/$SC 13
-    // Locate '$' character in the MQTT message to identify RAPI command
-    int rapi_character_index = topic_string.indexOf('$');
-    DBUGVAR(rapi_character_index);
-    if (rapi_character_index > 1) {
-      DBUGF("Processing as RAPI");
-      // Print RAPI command from mqtt-sub topic e.g $SC
-      // ASSUME RAPI COMMANDS ARE ALWAYS PREFIX BY $ AND TWO CHARACTERS LONG)
-      String cmd = topic_string.substring(rapi_character_index);
-      if (payload.length() > 0)
-      {
-        // If MQTT msg contains a payload e.g $SC 13. Not all rapi commands have a payload e.g. $GC
-        cmd += " "+payload_str;
-      }
+  // If MQTT message is RAPI command
+  // Detect if MQTT message is a RAPI command e.g to set 13A <base-topic>/rapi/$SC 13
+  // Locate '$' character in the MQTT message to identify RAPI command
+  const char *rapi_character = (const char *)memchr(topic.c_str(), '$', topic.length());
+  int rapi_character_index = rapi_character ? rapi_character - topic.c_str() : -1;
+  DBUGVAR(rapi_character_index);
+  if (rapi_character_index > 1) {
+    DBUGF("Processing as RAPI");
+    // Print RAPI command from mqtt-sub topic e.g $SC
+    // ASSUME RAPI COMMANDS ARE ALWAYS PREFIX BY $ AND TWO CHARACTERS LONG)
+    String cmd = topic.toString().substring(rapi_character_index);
+    if (payload.length() > 0)
+    {
+      // If MQTT msg contains a payload e.g $SC 13. Not all rapi commands have a payload e.g. $GC
+      cmd += " "+payload.toString();
+    }
 
-      if(!evse.isRapiCommandBlocked(cmd))
+    if(!evse.isRapiCommandBlocked(cmd))
+    {
+      rapiSender.sendCmd(cmd, [](int ret)
       {
-        rapiSender.sendCmd(cmd, [](int ret)
+        if (RAPI_RESPONSE_OK == ret || RAPI_RESPONSE_NK == ret)
         {
-          if (RAPI_RESPONSE_OK == ret || RAPI_RESPONSE_NK == ret)
-          {
-            String rapiString = rapiSender.getResponse();
-            String mqtt_data = rapiString;
-            String mqtt_sub_topic = mqtt_topic + "/rapi/out";
-            mqttclient.publish(mqtt_sub_topic, mqtt_data);
-          }
-        });
-      }
+          String rapiString = rapiSender.getResponse();
+          String mqtt_data = rapiString;
+          String mqtt_sub_topic = mqtt_topic + "/rapi/out";
+          // Control replies are never held back by mqtt_scheduler
+          mqttclient.publish(mqtt_sub_topic, mqtt_data);
+        }
+      });
     }
   }
 } //end call back
@@ -276,6 +368,17 @@ mqtt_connect()
   }
   connecting = true;
 
+  // Any change to the topics restarts the connection, so they are routed and
+  // built here, before connecting so they are also used to queue messages
+  mqtt_build_routes();
+  mqtt_topics.begin(mqtt_topic);
+
+  mqtt_format =
+    mqtt_publish_format == "json" ? MQTT_PUBLISH_FORMAT_JSON :
+    mqtt_publish_format == "msgpack" ? MQTT_PUBLISH_FORMAT_MSGPACK :
+    MQTT_PUBLISH_FORMAT_TOPICS;
+  mqtt_event_topic = mqtt_topic + "/event";
+  mqtt_replay_topic = mqtt_topic + "/replay";
   mqttclient.onMessage(mqttmsg_callback); //function to be called when mqtt msg is received on subscribed topic
   mqttclient.onError([](int err)
   {
@@ -361,12 +464,14 @@ mqtt_connect()
     doc["mqtt_connected"] = 1;
     event_send(doc);
 
-    // Publish MQTT override/claim
-    mqtt_publish_config();
-    mqtt_publish_override();
-    mqtt_publish_claim();
-    mqtt_publish_schedule();
-    mqtt_publish_limit();
+    // The broker may have lost any non-retained values, resend everything
+    mqtt_publish_cache.clear();
+    publishRefreshTime = millis();
+
+    // Republish override/claim/schedule/limit/config from mqtt_loop() as the bulk
+    // rate allows, rather than filling the send buffer with them all at once
+    mqtt_scheduler.reset();
+    mqtt_republish = MQTT_REPUBLISH_ALL;
 
     // MQTT Topic to subscribe to receive RAPI commands via MQTT
     String mqtt_sub_topic = mqtt_topic + "/rapi/in/#";
@@ -375,6 +480,12 @@ mqtt_connect()
     mqttclient.subscribe(mqtt_sub_topic);
     yield();
 
+    // The queued messages are confirmed by the broker sending them back, without
+    // the subscription they are not waited for. Anything sent before the
+    // connection was lost is sent again.
+    mqtt_queue.setConfirm(config_mqtt_replay() && mqttclient.subscribe(mqtt_replay_topic));
+    mqtt_queue.rewind();
+
     // subscribe to solar PV / grid_ie MQTT feeds
     if(config_divert_enabled())
     {
@@ -464,29 +575,208 @@ mqtt_connect()
 
 
 
+// The keys of state changes, the energy used and the session changes it is billed
+// from. These are published ahead of the rest of the status and are queued while
+// the broker is unreachable.
+static const char * const mqtt_state_keys[] = {
+  "state",
+  "vehicle",
+  "session_energy",
+  "session_elapsed",
+  "total_energy",
+  "total_day",
+  "total_week",
+  "total_month",
+  "total_year",
+  "total_switches",
+  "imported"
+};
+
+static bool mqtt_is_state_key(const char *key)
+{
+  for(const char *state : mqtt_state_keys)
+  {
+    if(0 == strcmp(key, state)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool mqtt_publish_document(JsonDocument &data, const char *json, size_t json_length, bool connected, MqttPriority priority);
+
 // -------------------------------------------------------------------
 // Publish status to MQTT
 // -------------------------------------------------------------------
 void
-mqtt_publish(JsonDocument &data) {
+mqtt_publish(JsonDocument &data, const char *json, size_t json_length) {
   Profile_Start(mqtt_publish);
 
-  if(!config_mqtt_enabled() || !mqttclient.connected()) {
+  // While disconnected only the state keys are looked at, and only if they are
+  // to be replayed once reconnected
+  bool connected = mqttclient.connected();
+  if(!config_mqtt_enabled() || (!connected && !config_mqtt_replay())) {
     return;
   }
 
-  JsonObject root = data.as<JsonObject>();
-  for (JsonPair kv : root) {
-    String topic = mqtt_topic + "/";
-    topic += kv.key().c_str();
-    String val = kv.value().as<String>();
-    mqttclient.publish(topic, val, config_mqtt_retained());
-    topic = mqtt_topic + "/";
+  // Values are formatted the same as as<String>(), strings are used in place
+  char buffer[MQTT_PUBLISH_VALUE_SIZE];
+  bool changed = false;
+  MqttPriority priority = MqttPriority_Telemetry;
+
+  JsonObjectConst root = data.as<JsonObjectConst>();
+  for (JsonPairConst kv : root) {
+    const char *key = kv.key().c_str();
+    bool state = mqtt_is_state_key(key);
+    if(!connected && !state) {
+      continue;
+    }
+
+    uint32_t key_hash = MqttPublishCache::hash(key, strlen(key));
+
+    const char *val = kv.value().as<const char *>();
+    size_t length;
+    String large;
+    if(NULL != val) {
+      length = strlen(val);
+    } else {
+      length = serializeJson(kv.value(), buffer, sizeof(buffer));
+      val = buffer;
+      if(length >= sizeof(buffer) - 1) {
+        // Possibly truncated, fall back to the heap
+        large = kv.value().as<String>();
+        val = large.c_str();
+        length = large.length();
+      }
+    }
+
+    if(mqtt_publish_cache.changed(key_hash, val, length))
+    {
+      changed = true;
+      if(state) {
+        priority = MqttPriority_State;
+      }
+
+      if(MQTT_PUBLISH_FORMAT_TOPICS == mqtt_format)
+      {
+        const char *topic = mqtt_topics.get(key, key_hash);
+        if(NULL == topic) {
+          // Too long to publish
+          continue;
+        }
+        if(!connected) {
+          mqtt_queue.push(topic, (const uint8_t *)val, length);
+        } else if(mqtt_scheduler.reserve(state ? MqttPriority_State : MqttPriority_Telemetry, strlen(topic) + length)) {
+          mqttclient.publish(topic, val, config_mqtt_retained());
+        } else {
+          // Held back, publish the value next time round even if unchanged
+          mqtt_publish_cache.forget(key_hash);
+        }
+      }
+    }
+  }
+
+  if(changed && MQTT_PUBLISH_FORMAT_TOPICS != mqtt_format &&
+     !mqtt_publish_document(data, json, json_length, connected, priority))
+  {
+    for (JsonPairConst kv : root) {
+      const char *key = kv.key().c_str();
+      mqtt_publish_cache.forget(MqttPublishCache::hash(key, strlen(key)));
+    }
   }
 
   Profile_End(mqtt_publish, 5);
 }
 
+// -------------------------------------------------------------------
+// Publish a message queued while disconnected to <mqtt_topic>/replay as
+// {"topic":"<topic>","time":<time queued>,"value":<payload>}, so it is not taken
+// for a current value. The time is null if the clock was not set when queued. JSON and MessagePack payloads are included as JSON, any
+// other payload as a string. ack is set to the hash of the message, the broker
+// sending it back to mqtt_on_replay() confirms it.
+// -------------------------------------------------------------------
+static bool
+mqtt_publish_queued(const char *topic, const uint8_t *payload, size_t length, time_t time, uint32_t &ack)
+{
+  DynamicJsonDocument value(JSON_OBJECT_SIZE(1) + 2 * length + 64);
+  bool msgpack = length > 0 && (0x80 == (payload[0] & 0xf0) || 0xde == payload[0] || 0xdf == payload[0]);
+  DeserializationError error = msgpack ?
+    deserializeMsgPack(value, payload, length) :
+    deserializeJson(value, payload, length);
+
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(3) + value.memoryUsage() + length + 64);
+  doc["topic"] = topic;
+  if(time > 0) {
+    doc["time"] = (uint32_t)time;
+  } else {
+    doc["time"] = (const char *)NULL;
+  }
+  if(error) {
+    doc["value"] = (const char *)payload;
+  } else {
+    doc["value"] = value.as<JsonVariantConst>();
+  }
+
+  String json;
+  serializeJson(doc, json);
+
+  // Sent as telemetry, the bulk heap floor could hold the queue back indefinitely
+  if(!mqtt_scheduler.reserve(MqttPriority_Telemetry, mqtt_replay_topic.length() + json.length())) {
+    return false;
+  }
+
+  ack = MqttPublishCache::hash(json.c_str(), json.length());
+  return mqttclient.publish(mqtt_replay_topic.c_str(), mg_mk_str_n(json.c_str(), json.length()), false);
+}
+
+// -------------------------------------------------------------------
+// Publish the whole event as one document to <mqtt_topic>/event, returns false
+// if it was held back by the scheduler. In the JSON format json, if given, is
+// published as is.
+// -------------------------------------------------------------------
+static bool
+mqtt_publish_document(JsonDocument &data, const char *json, size_t json_length, bool connected, MqttPriority priority)
+{
+  bool msgpack = MQTT_PUBLISH_FORMAT_MSGPACK == mqtt_format;
+  if(!msgpack && NULL != json)
+  {
+    if(connected && !mqtt_scheduler.reserve(priority, mqtt_event_topic.length() + json_length)) {
+      return false;
+    }
+
+    if(connected) {
+      mqttclient.publish(mqtt_event_topic.c_str(), mg_mk_str_n(json, json_length), config_mqtt_retained());
+    } else {
+      mqtt_queue.push(mqtt_event_topic.c_str(), (const uint8_t *)json, json_length);
+    }
+    return true;
+  }
+
+  // Room for the terminator serializeJson() adds
+  size_t size = (msgpack ? measureMsgPack(data) : measureJson(data)) + 1;
+
+  if(connected && !mqtt_scheduler.reserve(priority, mqtt_event_topic.length() + size)) {
+    return false;
+  }
+
+  uint8_t *payload = size <= sizeof(mqtt_publish_buffer) ? mqtt_publish_buffer : new uint8_t[size];
+  size_t length = msgpack ?
+    serializeMsgPack(data, payload, size) :
+    serializeJson(data, (char *)payload, size);
+
+  if(connected) {
+    mqttclient.publish(mqtt_event_topic.c_str(), mg_mk_str_n((const char *)payload, length), config_mqtt_retained());
+  } else {
+    mqtt_queue.push(mqtt_event_topic.c_str(), payload, length);
+  }
+
+  if(payload != mqtt_publish_buffer) {
+    delete[] payload;
+  }
+
+  return true;
+}
+
 void
 mqtt_set_claim(bool override, EvseProperties &props) {
   Profile_Start(mqtt_set_claim);
@@ -505,10 +795,10 @@ mqtt_set_claim(bool override, EvseProperties &props) {
   Profile_End(mqtt_set_claim, 5);
 }
 
-void
-mqtt_publish_claim() {
+bool
+mqtt_publish_claim(MqttPriority priority) {
   if(!config_mqtt_enabled() || !mqttclient.connected()) {
-    return;
+    return false;
   }
   bool hasclaim = evse.clientHasClaim(EvseClient_OpenEVSE_MQTT);
   const size_t capacity = JSON_OBJECT_SIZE(7) + 1024;
@@ -520,14 +810,14 @@ mqtt_publish_claim() {
   else {
     claimdata["state"] = "null";
   }
-  mqtt_publish_json(claimdata, "/claim");
+  return mqtt_publish_json(claimdata, "/claim", priority);
 }
 
-void
-mqtt_publish_override() {
+bool
+mqtt_publish_override(MqttPriority priority) {
   DBUGLN("MQTT publish_override()");
   if(!config_mqtt_enabled() || !mqttclient.connected()) {
-    return;
+    return false;
   }
   const size_t capacity = JSON_OBJECT_SIZE(7) + 1024;
   DynamicJsonDocument override_data(capacity);
@@ -539,7 +829,7 @@ mqtt_publish_override() {
     props.serialize(override_data);
   }
   else override_data["state"] = "null";
-  mqtt_publish_json(override_data, "/override");
+  return mqtt_publish_json(override_data, "/override", priority);
 }
 
 void mqtt_set_schedule(String schedule) {
@@ -557,29 +847,30 @@ mqtt_clear_schedule(uint32_t event) {
   mqtt_publish_schedule();
 }
 
-void
-mqtt_publish_schedule() {
+bool
+mqtt_publish_schedule(MqttPriority priority) {
   if(!config_mqtt_enabled() || !mqttclient.connected()) {
-    return;
+    return false;
   }
   const size_t capacity = JSON_OBJECT_SIZE(40) + 2048;
   DynamicJsonDocument schedule_data(capacity);
   EvseProperties props;
   bool success = scheduler.serialize(schedule_data);
-  if (success) {
-    mqtt_publish_json(schedule_data, "/schedule");
-  }
+  // Nothing to publish is not retried
+  return !success || mqtt_publish_json(schedule_data, "/schedule", priority);
 }
 
 bool
-mqtt_publish_config() {
+mqtt_publish_config(MqttPriority priority) {
   if(!config_mqtt_enabled() || !mqttclient.connected() || evse.getEvseState() == OPENEVSE_STATE_STARTING) {
     return false;
   }
   const size_t capacity = JSON_OBJECT_SIZE(128) + 1024;
   DynamicJsonDocument doc(capacity);
   config_serialize(doc, true, false, true);
-  mqtt_publish_json(doc, "/config");
+  if(!mqtt_publish_json(doc, "/config", priority)) {
+    return false;
+  }
 
   if(config_version() == INITIAL_CONFIG_VERSION) {
     String fulltopic = mqtt_topic + "/config_version";
@@ -598,29 +889,33 @@ mqtt_set_limit(LimitProperties &limitProps) {
   Profile_End(mqtt_set_limit, 5);
 }
 
-void
-mqtt_publish_limit() {
+bool
+mqtt_publish_limit(MqttPriority priority) {
   LimitProperties limitProps;
   const size_t capacity = JSON_OBJECT_SIZE(3) + 512;
   DynamicJsonDocument limit_data(capacity);
   limitProps = limit.get();
   bool success = limitProps.serialize(limit_data);
-  mqtt_publish_json(limit_data, "/limit");
+  return mqtt_publish_json(limit_data, "/limit", priority);
 }
 
-void
-mqtt_publish_json(JsonDocument &data, const char* topic) {
+bool
+mqtt_publish_json(JsonDocument &data, const char* topic, MqttPriority priority) {
   Profile_Start(mqtt_publish_json);
   if(!config_mqtt_enabled() || !mqttclient.connected()) {
-      return;
+      return false;
       }
 
   String fulltopic = mqtt_topic + topic;
   String doc;
   serializeJson(data, doc);
+  if(!mqtt_scheduler.reserve(priority, fulltopic.length() + doc.length())) {
+    return false;
+  }
   mqttclient.publish(fulltopic,doc, true); // claims are always published as retained as they are not updated regularly
   Profile_End(mqtt_publish_json, 5);
 
+  return true;
 }
 
 void
@@ -649,6 +944,10 @@ void mqtt_loop()
 {
   Profile_Start(mqtt_loop);
 
+  if (config_mqtt_enabled()) {
+    mqtt_queue.begin();
+  }
+
   // Do we need to restart MQTT?
   if(mqttRestartTime > 0 && millis() > mqttRestartTime)
   {
@@ -675,34 +974,68 @@ void mqtt_loop()
   // Temporise loop
   if (millis() - loop_timer > MQTT_LOOP) {
     loop_timer = millis();
-    if (claimsVersion != evse.getClaimsVersion()) {
-      mqtt_publish_claim();
+
+    // A change is published as a state change, the republish after connecting
+    // as bulk. Anything held back by the scheduler is tried again next time.
+    uint32_t version = evse.getClaimsVersion();
+    if ((claimsVersion != version || (mqtt_republish & MQTT_REPUBLISH_CLAIM)) &&
+        mqtt_publish_claim(claimsVersion != version ? MqttPriority_State : MqttPriority_Bulk))
+    {
       DBUGF("Claims has changed, publishing to MQTT");
-      claimsVersion = evse.getClaimsVersion();
+      claimsVersion = version;
+      mqtt_republish &= ~MQTT_REPUBLISH_CLAIM;
     }
 
-    if (overrideVersion != manual.getVersion()) {
-      mqtt_publish_override();
+    version = manual.getVersion();
+    if ((overrideVersion != version || (mqtt_republish & MQTT_REPUBLISH_OVERRIDE)) &&
+        mqtt_publish_override(overrideVersion != version ? MqttPriority_State : MqttPriority_Bulk))
+    {
       DBUGF("Override has changed, publishing to MQTT");
-      overrideVersion = manual.getVersion();
+      overrideVersion = version;
+      mqtt_republish &= ~MQTT_REPUBLISH_OVERRIDE;
     }
 
-    if (scheduleVersion != scheduler.getVersion()) {
-      mqtt_publish_schedule();
+    version = scheduler.getVersion();
+    if ((scheduleVersion != version || (mqtt_republish & MQTT_REPUBLISH_SCHEDULE)) &&
+        mqtt_publish_schedule(scheduleVersion != version ? MqttPriority_State : MqttPriority_Bulk))
+    {
       DBUGF("Schedule has changed, publishing to MQTT");
-      scheduleVersion = scheduler.getVersion();
+      scheduleVersion = version;
+      mqtt_republish &= ~MQTT_REPUBLISH_SCHEDULE;
     }
-    if (limitVersion != limit.getVersion()) {
-      mqtt_publish_limit();
+
+    version = limit.getVersion();
+    if ((limitVersion != version || (mqtt_republish & MQTT_REPUBLISH_LIMIT)) &&
+        mqtt_publish_limit(limitVersion != version ? MqttPriority_State : MqttPriority_Bulk))
+    {
       DBUGF("Limit has changed, publishing to MQTT");
-      limitVersion = limit.getVersion();
+      limitVersion = version;
+      mqtt_republish &= ~MQTT_REPUBLISH_LIMIT;
     }
 
-    if(configVersion != config_version() && mqtt_publish_config()) {
+    if((configVersion != config_version() || (mqtt_republish & MQTT_REPUBLISH_CONFIG)) &&
+       mqtt_publish_config())
+    {
       DBUGF("Config has changed, publishing to MQTT");
       configVersion = config_version();
+      mqtt_republish &= ~MQTT_REPUBLISH_CONFIG;
+    }
+
+    if(MQTT_PUBLISH_REFRESH_TIME > 0 && millis() - publishRefreshTime > MQTT_PUBLISH_REFRESH_TIME) {
+      mqtt_publish_cache.clear();
+      publishRefreshTime = millis();
     }
   }
+
+  // Send what was queued while disconnected, a few messages at a time so the
+  // current status is not held up. Queued messages are never retained, they
+  // would replace the newer retained values.
+  if (mqttclient.connected() && !connecting && !mqtt_queue.empty() &&
+      millis() - queueDrainTime > MQTT_QUEUE_DRAIN_TIME)
+  {
+    queueDrainTime = millis();
+    mqtt_queue.drain(MQTT_QUEUE_DRAIN_COUNT, mqtt_publish_queued);
+  }
   Profile_End(mqtt_loop, 5);
 }
 
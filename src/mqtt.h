@@ -9,6 +9,7 @@
 #include <ArduinoJson.h>
 #include "evse_man.h"
 #include "limit.h"
+#include "mqtt_publish_scheduler.h"
 
 enum mqtt_protocol {
 	MQTT_PROTOCOL_MQTT,
@@ -17,8 +18,35 @@ enum mqtt_protocol {
 	MQTT_PROTOCOL_WEBSOCKET_SSL
 };
 
+enum mqtt_publish_format {
+	MQTT_PUBLISH_FORMAT_TOPICS,
+	MQTT_PUBLISH_FORMAT_JSON,
+	MQTT_PUBLISH_FORMAT_MSGPACK
+};
+
 #define MQTT_LOOP	500
 
+// Scratch space used to format each value published by mqtt_publish()
+#ifndef MQTT_PUBLISH_VALUE_SIZE
+#define MQTT_PUBLISH_VALUE_SIZE 128
+#endif
+
+// Messages sent from the outbound queue each MQTT_QUEUE_DRAIN_TIME (ms) once
+// reconnected
+#ifndef MQTT_QUEUE_DRAIN_COUNT
+#define MQTT_QUEUE_DRAIN_COUNT 4
+#endif
+
+#ifndef MQTT_QUEUE_DRAIN_TIME
+#define MQTT_QUEUE_DRAIN_TIME 100
+#endif
+
+// Buffer for the documents published in the json and msgpack formats, larger
+// documents are allocated
+#ifndef MQTT_PUBLISH_DOC_SIZE
+#define MQTT_PUBLISH_DOC_SIZE 1024
+#endif
+
 extern void mqtt_msg_callback();
 
 // -------------------------------------------------------------------
@@ -31,17 +59,21 @@ extern void mqtt_loop();
 // Publish values to MQTT
 //
 // data: a comma seperated list of name:value pairs to send
+// json: data already serialised as JSON, if available
+//
+// The retained topics return false if not published, either not connected or
+// held back by the rate limit for priority
 // -------------------------------------------------------------------
-extern void mqtt_publish(JsonDocument &data);
-extern bool mqtt_publish_config();
-extern void mqtt_publish_claim();
+extern void mqtt_publish(JsonDocument &data, const char *json = NULL, size_t length = 0);
+extern bool mqtt_publish_config(MqttPriority priority = MqttPriority_Bulk);
+extern bool mqtt_publish_claim(MqttPriority priority = MqttPriority_State);
 extern void mqtt_set_claim(bool override, EvseProperties &props);
-extern void mqtt_publish_override();
-extern void mqtt_publish_json(JsonDocument &data, const char* topic);
-extern void mqtt_publish_schedule();
+extern bool mqtt_publish_override(MqttPriority priority = MqttPriority_State);
+extern bool mqtt_publish_json(JsonDocument &data, const char* topic, MqttPriority priority = MqttPriority_State);
+extern bool mqtt_publish_schedule(MqttPriority priority = MqttPriority_State);
 extern void mqtt_set_schedule(String schedule);
 extern void mqtt_clear_schedule(uint32_t event);
-extern void mqtt_publish_limit();
+extern bool mqtt_publish_limit(MqttPriority priority = MqttPriority_State);
 extern void mqtt_set_limit(LimitProperties &limitProps);
 extern void mqtt_restart_device(String payload_str);
 
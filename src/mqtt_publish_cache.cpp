@@ -0,0 +1,93 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_MQTT)
+#undef ENABLE_DEBUG
+#endif
+
+#include "mqtt_publish_cache.h"
+#include "debug.h"
+
+MqttPublishCache::MqttPublishCache() :
+  _entries(),
+  _count(0)
+{
+}
+
+// FNV-1a
+uint32_t MqttPublishCache::hash(const char *data, size_t length, uint32_t hash)
+{
+  for(size_t i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+bool MqttPublishCache::changed(const char *key, const char *value, size_t length)
+{
+  return changed(hash(key, strlen(key)), value, length);
+}
+
+bool MqttPublishCache::changed(uint32_t key_hash, const char *value, size_t length)
+{
+  // 0 marks an empty entry
+  if(0 == key_hash) {
+    key_hash = 1;
+  }
+  uint32_t value_hash = hash(value, length);
+
+  // Open addressing with linear probing, entries are only removed by clear()
+  for(uint16_t i = 0; i < MQTT_PUBLISH_CACHE_SIZE; i++)
+  {
+    Entry &entry = _entries[(key_hash + i) & (MQTT_PUBLISH_CACHE_SIZE - 1)];
+    if(key_hash == entry.key)
+    {
+      if(value_hash == entry.value) {
+        return false;
+      }
+      entry.value = value_hash;
+      return true;
+    }
+
+    if(0 == entry.key)
+    {
+      // Keep a free entry so a lookup of an unknown key always terminates early
+      if(_count < MQTT_PUBLISH_CACHE_SIZE - 1)
+      {
+        entry.key = key_hash;
+        entry.value = value_hash;
+        _count++;
+      }
+      return true;
+    }
+  }
+
+  return true;
+}
+
+void MqttPublishCache::forget(uint32_t key_hash)
+{
+  if(0 == key_hash) {
+    key_hash = 1;
+  }
+
+  for(uint16_t i = 0; i < MQTT_PUBLISH_CACHE_SIZE; i++)
+  {
+    Entry &entry = _entries[(key_hash + i) & (MQTT_PUBLISH_CACHE_SIZE - 1)];
+    if(key_hash == entry.key)
+    {
+      // The entry is kept so the probe chains stay intact
+      entry.value = ~entry.value;
+      return;
+    }
+    if(0 == entry.key) {
+      return;
+    }
+  }
+}
+
+void MqttPublishCache::clear()
+{
+  DBUGF("Clearing MQTT publish cache, %d keys", _count);
+  memset(_entries, 0, sizeof(_entries));
+  _count = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _OPENEVSE_MQTT_PUBLISH_CACHE_H
+#define _OPENEVSE_MQTT_PUBLISH_CACHE_H
+
+// Number of keys whose last published value is remembered, must be a power of 2
+#ifndef MQTT_PUBLISH_CACHE_SIZE
+#define MQTT_PUBLISH_CACHE_SIZE 128
+#endif
+
+// How often every key is published even if unchanged (ms), 0 to disable
+#ifndef MQTT_PUBLISH_REFRESH_TIME
+#define MQTT_PUBLISH_REFRESH_TIME (10 * 60 * 1000)
+#endif
+
+#include <Arduino.h>
+
+// Remembers a hash of the last value published for each key so unchanged values
+// can be suppressed. Only the hashes are stored, a collision on the value hash
+// would suppress a change until the next refresh.
+class MqttPublishCache
+{
+  private:
+    struct Entry {
+      uint32_t key;
+      uint32_t value;
+    };
+
+    Entry _entries[MQTT_PUBLISH_CACHE_SIZE];
+    uint16_t _count;
+
+  public:
+    MqttPublishCache();
+
+    // Returns true if value differs from the last value recorded for key, and
+    // records it. Keys that do not fit in the cache are always reported changed.
+    bool changed(const char *key, const char *value, size_t length);
+    // As above, key_hash is hash() of the key
+    bool changed(uint32_t key_hash, const char *value, size_t length);
+
+    // Forget the value recorded for key_hash, eg when it could not be published,
+    // so the next value is reported changed even if it is the same
+    void forget(uint32_t key_hash);
+
+    // Forget all the values so the next of each is published
+    void clear();
+
+    static uint32_t hash(const char *data, size_t length, uint32_t hash = 2166136261UL);
+};
+
+#endif // _OPENEVSE_MQTT_PUBLISH_CACHE_H
@@ -0,0 +1,116 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_MQTT)
+#undef ENABLE_DEBUG
+#endif
+
+#include "mqtt_publish_scheduler.h"
+#include "debug.h"
+#include "espal.h"
+
+const uint32_t MqttPublishScheduler::_rate[MqttPriority_Count] = {
+  0,
+  MQTT_RATE_STATE,
+  MQTT_RATE_TELEMETRY,
+  MQTT_RATE_BULK
+};
+
+const uint32_t MqttPublishScheduler::_burst[MqttPriority_Count] = {
+  0,
+  MQTT_BURST_STATE,
+  MQTT_BURST_TELEMETRY,
+  MQTT_BURST_BULK
+};
+
+const uint32_t MqttPublishScheduler::_minHeap[MqttPriority_Count] = {
+  0,
+  MQTT_MIN_HEAP_STATE,
+  MQTT_MIN_HEAP_TELEMETRY,
+  MQTT_MIN_HEAP_BULK
+};
+
+MqttPublishScheduler::MqttPublishScheduler() :
+  _buckets(),
+  _deferred(0)
+{
+  reset();
+}
+
+void MqttPublishScheduler::reset()
+{
+  unsigned long now = millis();
+  for(uint8_t i = 0; i < MqttPriority_Count; i++)
+  {
+    _buckets[i].tokens = _burst[i];
+    _buckets[i].lastRefill = now;
+    _buckets[i].waiting = false;
+  }
+}
+
+void MqttPublishScheduler::refill(MqttPriority priority)
+{
+  Bucket &bucket = _buckets[priority];
+  unsigned long now = millis();
+  long tokens = ((now - bucket.lastRefill) * _rate[priority]) / 1000;
+  if(tokens > 0)
+  {
+    bucket.tokens += tokens;
+    if(bucket.tokens > (long)_burst[priority]) {
+      bucket.tokens = _burst[priority];
+    }
+    bucket.lastRefill = now;
+  }
+}
+
+bool MqttPublishScheduler::defer(MqttPriority priority)
+{
+  Bucket &bucket = _buckets[priority];
+  unsigned long now = millis();
+  // Not held back since long ago, eg the message was given up on, starts again
+  if(!bucket.waiting || now - bucket.lastDeferred > MQTT_MAX_WAIT)
+  {
+    bucket.waiting = true;
+    bucket.waitingSince = now;
+  }
+  bucket.lastDeferred = now;
+
+  DBUGF("MQTT priority %d deferred, %ld tokens", priority, bucket.tokens);
+  _deferred++;
+  return false;
+}
+
+// A higher class, other than control, has been held back and not published since
+bool MqttPublishScheduler::higherWaiting(MqttPriority priority)
+{
+  unsigned long now = millis();
+  for(uint8_t i = MqttPriority_State; i < priority; i++)
+  {
+    if(_buckets[i].waiting && now - _buckets[i].lastDeferred < MQTT_PRECEDENCE_TIME) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MqttPublishScheduler::reserve(MqttPriority priority, size_t length)
+{
+  if(MqttPriority_Control == priority) {
+    return true;
+  }
+
+  refill(priority);
+  Bucket &bucket = _buckets[priority];
+
+  // Once a class has waited long enough it is no longer held back by the higher
+  // classes, and only has to leave the heap a state change needs
+  bool overdue = bucket.waiting && millis() - bucket.waitingSince > MQTT_MAX_WAIT;
+  uint32_t minHeap = overdue ? _minHeap[MqttPriority_State] : _minHeap[priority];
+
+  if(bucket.tokens <= 0 || (!overdue && higherWaiting(priority)) ||
+     ESPAL.getFreeHeap() < minHeap)
+  {
+    return defer(priority);
+  }
+
+  bucket.waiting = false;
+  bucket.tokens -= length;
+  return true;
+}
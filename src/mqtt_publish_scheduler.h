@@ -0,0 +1,121 @@
+#ifndef _OPENEVSE_MQTT_PUBLISH_SCHEDULER_H
+#define _OPENEVSE_MQTT_PUBLISH_SCHEDULER_H
+
+// The rate each class of message is published at (bytes/s) and the burst allowed
+// on top of that, control replies are never limited
+#ifndef MQTT_RATE_STATE
+#define MQTT_RATE_STATE 2048
+#endif
+
+#ifndef MQTT_BURST_STATE
+#define MQTT_BURST_STATE 4096
+#endif
+
+#ifndef MQTT_RATE_TELEMETRY
+#define MQTT_RATE_TELEMETRY 2048
+#endif
+
+#ifndef MQTT_BURST_TELEMETRY
+#define MQTT_BURST_TELEMETRY 4096
+#endif
+
+#ifndef MQTT_RATE_BULK
+#define MQTT_RATE_BULK 1024
+#endif
+
+#ifndef MQTT_BURST_BULK
+#define MQTT_BURST_BULK 2048
+#endif
+
+// The free heap that has to be left before state changes, telemetry and bulk
+// messages are added to the send buffer
+#ifndef MQTT_MIN_HEAP_STATE
+#define MQTT_MIN_HEAP_STATE (8 * 1024)
+#endif
+
+#ifndef MQTT_MIN_HEAP_TELEMETRY
+#define MQTT_MIN_HEAP_TELEMETRY (16 * 1024)
+#endif
+
+#ifndef MQTT_MIN_HEAP_BULK
+#define MQTT_MIN_HEAP_BULK (24 * 1024)
+#endif
+
+// How long a class is held back before it is let through ahead of the higher
+// classes and down to the state heap floor, so a device that is always short of
+// heap still republishes its config (ms)
+#ifndef MQTT_MAX_WAIT
+#define MQTT_MAX_WAIT (30 * 1000)
+#endif
+
+// How long a class that was held back keeps the lower classes waiting, after
+// that it is taken to have nothing more to send (ms)
+#ifndef MQTT_PRECEDENCE_TIME
+#define MQTT_PRECEDENCE_TIME 1000
+#endif
+
+#include <Arduino.h>
+
+// The classes of MQTT message, highest priority first
+enum MqttPriority : uint8_t
+{
+  // Replies to commands, eg rapi/out
+  MqttPriority_Control,
+  // Claim, override and EVSE state changes
+  MqttPriority_State,
+  // The periodic status values and the messages queued while disconnected
+  MqttPriority_Telemetry,
+  // Config, schedule and limit
+  MqttPriority_Bulk,
+
+  MqttPriority_Count
+};
+
+// Decides if a message can be published now. Each class has a token bucket of
+// bytes so a burst of a lower class (eg republishing everything on reconnect)
+// can not use the bandwidth of a higher one, and the lower classes are held back
+// while the free heap, which the Mongoose send buffer is allocated from, is low.
+// While a higher class is waiting to publish the lower classes are held back too,
+// so they do not fill the send buffer ahead of it.
+//
+// A message bigger than the tokens left is still allowed if there are any, the
+// class then has to wait for its bucket to refill.
+class MqttPublishScheduler
+{
+  private:
+    struct Bucket {
+      long tokens;
+      unsigned long lastRefill;
+      bool waiting;
+      unsigned long waitingSince;
+      unsigned long lastDeferred;
+    };
+
+    Bucket _buckets[MqttPriority_Count];
+    uint32_t _deferred;
+
+    static const uint32_t _rate[MqttPriority_Count];
+    static const uint32_t _burst[MqttPriority_Count];
+    static const uint32_t _minHeap[MqttPriority_Count];
+
+    void refill(MqttPriority priority);
+    bool defer(MqttPriority priority);
+    bool higherWaiting(MqttPriority priority);
+
+  public:
+    MqttPublishScheduler();
+
+    // Fill all the buckets, eg on connect
+    void reset();
+
+    // Returns true if a message of length bytes may be published at priority now,
+    // and takes the bytes from its bucket
+    bool reserve(MqttPriority priority, size_t length);
+
+    // The number of messages reserve() has refused
+    uint32_t getDeferred() {
+      return _deferred;
+    }
+};
+
+#endif // _OPENEVSE_MQTT_PUBLISH_SCHEDULER_H
@@ -0,0 +1,306 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_MQTT)
+#undef ENABLE_DEBUG
+#endif
+
+#include <LittleFS.h>
+
+#include "mqtt_queue.h"
+#include "mqtt_topics.h"
+#include "debug.h"
+
+#define MQTT_QUEUE_RECORD_MAGIC 0xA5
+
+// 0 marks a skipped range so is not used for a message
+#define MQTT_QUEUE_ACK(ack) (0 == (ack) ? 1 : (ack))
+
+// The time now, or 0 if the clock has not been set yet
+static uint32_t mqtt_queue_time()
+{
+  time_t now = time(NULL);
+  struct tm timeinfo;
+  gmtime_r(&now, &timeinfo);
+  return timeinfo.tm_year < (2021 - 1900) ? 0 : now;
+}
+
+MqttQueue::MqttQueue() :
+  _started(false),
+  _head(0),
+  _sent(0),
+  _size(0),
+  _dropped(0),
+  _inflight(),
+  _inflightCount(0),
+  _attempts(0),
+  _confirm(true),
+  _confirmed(false),
+  _ackTime(0)
+{
+}
+
+void MqttQueue::begin()
+{
+  if(_started) {
+    return;
+  }
+  _started = true;
+
+  // Anything left from before a restart is sent again
+  _head = 0;
+  _sent = 0;
+  _size = 0;
+  _inflightCount = 0;
+  File file = LittleFS.open(MQTT_QUEUE_FILE, "r");
+  if(file)
+  {
+    _size = file.size();
+    file.close();
+    DBUGF("MQTT queue has %d bytes waiting", _size);
+  }
+}
+
+void MqttQueue::reset()
+{
+  LittleFS.remove(MQTT_QUEUE_FILE);
+  _head = 0;
+  _sent = 0;
+  _size = 0;
+  _inflightCount = 0;
+}
+
+void MqttQueue::rewind()
+{
+  _sent = _head;
+  _inflightCount = 0;
+}
+
+void MqttQueue::setConfirm(bool confirm)
+{
+  _confirm = confirm;
+  _confirmed = false;
+  _attempts = 0;
+}
+
+// Remove the oldest message sent, and any skipped range after it
+void MqttQueue::pop()
+{
+  do
+  {
+    _head += _inflight[0].length;
+    _inflightCount--;
+    memmove(_inflight, _inflight + 1, _inflightCount * sizeof(Inflight));
+  } while(_inflightCount > 0 && 0 == _inflight[0].ack);
+}
+
+bool MqttQueue::ack(uint32_t ack)
+{
+  // Confirmations are getting through, even if not for this message
+  _confirmed = true;
+
+  if(0 == _inflightCount || MQTT_QUEUE_ACK(ack) != _inflight[0].ack) {
+    return false;
+  }
+
+  pop();
+  _attempts = 0;
+  _ackTime = millis();
+
+  if(empty()) {
+    reset();
+  }
+
+  return true;
+}
+
+// Read the record header and topic at position, returns false if it is not a
+// valid record
+bool MqttQueue::readHeader(File &file, uint32_t position, Record &record, char *topic, size_t topicSize)
+{
+  if(!file.seek(position) ||
+     sizeof(record) != file.read((uint8_t *)&record, sizeof(record)) ||
+     MQTT_QUEUE_RECORD_MAGIC != record.magic ||
+     0 == record.topicLength || record.topicLength >= topicSize ||
+     record.payloadLength > MQTT_QUEUE_MAX_PAYLOAD ||
+     position + sizeof(record) + record.topicLength + record.payloadLength > _size ||
+     record.topicLength != file.read((uint8_t *)topic, record.topicLength))
+  {
+    return false;
+  }
+  topic[record.topicLength] = '\0';
+
+  for(uint8_t i = 0; i < record.topicLength; i++)
+  {
+    if(topic[i] < ' ' || '+' == topic[i] || '#' == topic[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Find the next valid record after a corrupt one, eg a short write at power loss,
+// returns _size if there is none
+uint32_t MqttQueue::resync(File &file, uint32_t from)
+{
+  char topic[MQTT_TOPIC_MAX_LENGTH];
+  uint8_t buffer[32];
+
+  for(uint32_t position = from; position < _size; )
+  {
+    if(!file.seek(position)) {
+      break;
+    }
+    size_t length = file.read(buffer, sizeof(buffer));
+    if(0 == length) {
+      break;
+    }
+
+    for(size_t i = 0; i < length; i++)
+    {
+      Record record;
+      if(MQTT_QUEUE_RECORD_MAGIC == buffer[i] &&
+         readHeader(file, position + i, record, topic, sizeof(topic)))
+      {
+        return position + i;
+      }
+    }
+
+    position += length;
+  }
+
+  return _size;
+}
+
+bool MqttQueue::push(const char *topic, const uint8_t *payload, size_t length)
+{
+  size_t topicLength = strlen(topic);
+  size_t recordLength = sizeof(Record) + topicLength + length;
+  // The same limits readHeader() checks, a record it would reject is not written
+  if(!_started || 0 == topicLength || topicLength >= MQTT_TOPIC_MAX_LENGTH ||
+     length > MQTT_QUEUE_MAX_PAYLOAD || _size + recordLength > MQTT_QUEUE_MAX_SIZE)
+  {
+    _dropped++;
+    return false;
+  }
+
+  File file = LittleFS.open(MQTT_QUEUE_FILE, FILE_APPEND);
+  if(!file) {
+    _dropped++;
+    return false;
+  }
+
+  Record record;
+  record.magic = MQTT_QUEUE_RECORD_MAGIC;
+  record.topicLength = topicLength;
+  record.payloadLength = length;
+  record.time = mqtt_queue_time();
+
+  size_t written = file.write((const uint8_t *)&record, sizeof(record));
+  written += file.write((const uint8_t *)topic, topicLength);
+  written += file.write(payload, length);
+  file.close();
+
+  _size += written;
+  if(written != recordLength)
+  {
+    // Out of space, the partial record is caught by the size check when read
+    DBUGF("MQTT queue write failed");
+    _dropped++;
+    return false;
+  }
+
+  return true;
+}
+
+size_t MqttQueue::drain(size_t count, MqttQueueHandler publish)
+{
+  if(_inflightCount > 0 && millis() - _ackTime > MQTT_QUEUE_ACK_TIMEOUT)
+  {
+    if(!_confirmed)
+    {
+      // Nothing has come back since connecting, eg the broker does not allow the
+      // subscription, what was sent is done with and the rest is not waited for
+      DBUGF("MQTT queue not confirmed by the broker, no longer waiting");
+      _confirm = false;
+      _head = _sent;
+      _inflightCount = 0;
+    }
+    else if(++_attempts >= MQTT_QUEUE_MAX_ATTEMPTS)
+    {
+      DBUGF("MQTT queue message at %d not confirmed, dropping", _head);
+      _attempts = 0;
+      _dropped++;
+      pop();
+    }
+
+    DBUGF("MQTT queue not confirmed, sending again from %d", _head);
+    rewind();
+  }
+
+  if(empty())
+  {
+    reset();
+    return 0;
+  }
+
+  if(_sent >= _size || 0 == count) {
+    return 0;
+  }
+
+  File file = LittleFS.open(MQTT_QUEUE_FILE, "r");
+  if(!file)
+  {
+    reset();
+    return 0;
+  }
+
+  char topic[MQTT_TOPIC_MAX_LENGTH];
+  uint8_t payload[MQTT_QUEUE_MAX_PAYLOAD + 1];
+
+  size_t published = 0;
+  while(published < count && _sent < _size && _inflightCount < MQTT_QUEUE_MAX_INFLIGHT)
+  {
+    Record record;
+    if(!readHeader(file, _sent, record, topic, sizeof(topic)) ||
+       record.payloadLength != file.read(payload, record.payloadLength))
+    {
+      // Skip to the next record rather than lose the rest of the queue
+      uint32_t next = resync(file, _sent + 1);
+      DBUGF("MQTT queue corrupt at %d, skipping %d bytes", _sent, next - _sent);
+      _inflight[_inflightCount++] = { 0, next - _sent };
+      _sent = next;
+      continue;
+    }
+    payload[record.payloadLength] = '\0';
+
+    uint32_t ack = 0;
+    if(!publish(topic, payload, record.payloadLength, record.time, ack)) {
+      break;
+    }
+
+    if(0 == _inflightCount) {
+      _ackTime = millis();
+    }
+    _inflight[_inflightCount++] = { MQTT_QUEUE_ACK(ack), (uint32_t)(sizeof(record) + record.topicLength + record.payloadLength) };
+    _sent += sizeof(record) + record.topicLength + record.payloadLength;
+    published++;
+  }
+  file.close();
+
+  if(!_confirm)
+  {
+    // Nothing will be confirmed, what was published is done with
+    _head = _sent;
+    _inflightCount = 0;
+  }
+  else if(_inflightCount > 0 && 0 == _inflight[0].ack)
+  {
+    // A skipped range at the front has nothing to wait for
+    pop();
+  }
+
+  if(empty()) {
+    reset();
+  }
+
+  return published;
+}
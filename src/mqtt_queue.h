@@ -0,0 +1,126 @@
+#ifndef _OPENEVSE_MQTT_QUEUE_H
+#define _OPENEVSE_MQTT_QUEUE_H
+
+#ifndef MQTT_QUEUE_FILE
+#define MQTT_QUEUE_FILE "/mqtt_queue"
+#endif
+
+// Maximum size of the queue file, messages are not queued once it is full
+#ifndef MQTT_QUEUE_MAX_SIZE
+#define MQTT_QUEUE_MAX_SIZE (32 * 1024)
+#endif
+
+// Largest payload that can be queued
+#ifndef MQTT_QUEUE_MAX_PAYLOAD
+#define MQTT_QUEUE_MAX_PAYLOAD 1024
+#endif
+
+// Messages published but not yet confirmed by the broker
+#ifndef MQTT_QUEUE_MAX_INFLIGHT
+#define MQTT_QUEUE_MAX_INFLIGHT 8
+#endif
+
+// How long to wait for the broker to confirm a message before sending everything
+// not confirmed again (ms)
+#ifndef MQTT_QUEUE_ACK_TIMEOUT
+#define MQTT_QUEUE_ACK_TIMEOUT (10 * 1000)
+#endif
+
+// Times the oldest message is sent without being confirmed before it is dropped
+#ifndef MQTT_QUEUE_MAX_ATTEMPTS
+#define MQTT_QUEUE_MAX_ATTEMPTS 3
+#endif
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <functional>
+
+// Publishes a queued message, time is when it was queued or 0 if the clock had not
+// been set. Returns false if it can not be sent now. Sets ack to the value the
+// broker's confirmation of the message will be passed to ack().
+// The payload is also NULL terminated.
+typedef std::function<bool(const char *topic, const uint8_t *payload, size_t length, time_t time, uint32_t &ack)> MqttQueueHandler;
+
+// Flash backed queue of the messages that could not be published while the
+// broker was unreachable. Records are appended to a file in LittleFS and read
+// back in order, the file is removed once it has been drained.
+//
+// A message is only removed once the broker has confirmed it, if that does not
+// happen within MQTT_QUEUE_ACK_TIMEOUT, or the connection is lost, everything not
+// confirmed is sent again. The oldest message is dropped after
+// MQTT_QUEUE_MAX_ATTEMPTS, and if nothing at all is confirmed the broker is taken
+// not to support confirmation and messages are removed once published. The read
+// position is only kept in RAM, so after a restart part way through draining
+// some messages are also sent again, at least once delivery.
+class MqttQueue
+{
+  private:
+    // Record header, followed by the topic and the payload
+    struct Record {
+      uint8_t magic;
+      uint8_t topicLength;
+      uint16_t payloadLength;
+      uint32_t time;
+    };
+
+    // A message sent but not confirmed, ack 0 marks a corrupt range skipped over
+    struct Inflight {
+      uint32_t ack;
+      uint32_t length;
+    };
+
+    bool _started;
+    uint32_t _head;
+    uint32_t _sent;
+    uint32_t _size;
+    uint32_t _dropped;
+    Inflight _inflight[MQTT_QUEUE_MAX_INFLIGHT];
+    uint8_t _inflightCount;
+    uint8_t _attempts;
+    bool _confirm;
+    bool _confirmed;
+    unsigned long _ackTime;
+
+    void reset();
+    void pop();
+    bool readHeader(File &file, uint32_t position, Record &record, char *topic, size_t topicSize);
+    uint32_t resync(File &file, uint32_t from);
+
+  public:
+    MqttQueue();
+
+    void begin();
+
+    bool push(const char *topic, const uint8_t *payload, size_t length);
+
+    // Pass up to count messages to publish, oldest first, that have not already
+    // been sent. Returns the number of messages published.
+    size_t drain(size_t count, MqttQueueHandler publish);
+
+    // The broker has confirmed a message, returns false if it is not the oldest
+    // message waiting to be confirmed
+    bool ack(uint32_t ack);
+
+    // Send everything not yet confirmed again, eg after reconnecting
+    void rewind();
+
+    // Wait for the broker to confirm each message, eg once subscribed to the
+    // confirmations, otherwise messages are removed as soon as they are published
+    void setConfirm(bool confirm);
+
+    bool empty() {
+      return _head >= _size;
+    }
+
+    uint32_t getSize() {
+      return _size - _head;
+    }
+
+    // Messages not queued because the queue was full, or dropped after not being
+    // confirmed
+    uint32_t getDropped() {
+      return _dropped;
+    }
+};
+
+#endif // _OPENEVSE_MQTT_QUEUE_H
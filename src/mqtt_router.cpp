@@ -0,0 +1,105 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_MQTT)
+#undef ENABLE_DEBUG
+#endif
+
+#include "mqtt_router.h"
+#include "mqtt_publish_cache.h"
+#include "debug.h"
+
+MqttRouter::MqttRouter() :
+  _routes(),
+  _count(0)
+{
+}
+
+void MqttRouter::clear()
+{
+  for(Route &route : _routes)
+  {
+    route.hash = 0;
+    route.topic = "";
+    route.handler = NULL;
+  }
+  _count = 0;
+}
+
+MqttRouter::Route *MqttRouter::find(const char *topic, size_t length, uint32_t hash)
+{
+  // Open addressing with linear probing, an empty slot ends the search
+  for(uint8_t i = 0; i < MQTT_ROUTER_SIZE; i++)
+  {
+    Route &route = _routes[(hash + i) & (MQTT_ROUTER_SIZE - 1)];
+    if(NULL == route.handler ||
+       (hash == route.hash && length == route.topic.length() &&
+        0 == memcmp(topic, route.topic.c_str(), length)))
+    {
+      return &route;
+    }
+  }
+
+  return NULL;
+}
+
+bool MqttRouter::on(const String &topic, MqttRouteHandler handler)
+{
+  // Keep a free slot so a miss always terminates
+  if(0 == topic.length() || _count >= MQTT_ROUTER_SIZE - 1) {
+    return false;
+  }
+
+  uint32_t hash = MqttPublishCache::hash(topic.c_str(), topic.length());
+  Route *route = find(topic.c_str(), topic.length(), hash);
+  if(NULL == route || NULL != route->handler) {
+    return false;
+  }
+
+  route->hash = hash;
+  route->topic = topic;
+  route->handler = handler;
+  _count++;
+  return true;
+}
+
+bool MqttRouter::dispatch(MongooseString topic, MongooseString payload)
+{
+  uint32_t hash = MqttPublishCache::hash(topic.c_str(), topic.length());
+  Route *route = find(topic.c_str(), topic.length(), hash);
+  if(NULL == route || NULL == route->handler) {
+    return false;
+  }
+
+  route->handler(payload);
+  return true;
+}
+
+long MqttRouter::toInt(MongooseString payload)
+{
+  const char *pos = payload.c_str();
+  const char *end = pos + payload.length();
+
+  while(pos < end && isspace(*pos)) {
+    pos++;
+  }
+
+  bool negative = false;
+  if(pos < end && ('-' == *pos || '+' == *pos)) {
+    negative = '-' == *pos++;
+  }
+
+  long value = 0;
+  while(pos < end && isdigit(*pos)) {
+    value = value * 10 + (*pos++ - '0');
+  }
+
+  return negative ? -value : value;
+}
+
+double MqttRouter::toFloat(MongooseString payload)
+{
+  // strtod needs a terminated string, the payload is not
+  char buffer[32];
+  size_t length = payload.length() < sizeof(buffer) - 1 ? payload.length() : sizeof(buffer) - 1;
+  memcpy(buffer, payload.c_str(), length);
+  buffer[length] = '\0';
+  return strtod(buffer, NULL);
+}
@@ -0,0 +1,47 @@
+#ifndef _OPENEVSE_MQTT_ROUTER_H
+#define _OPENEVSE_MQTT_ROUTER_H
+
+// Number of slots in the topic table, must be a power of 2 and larger than the
+// number of topics routed
+#ifndef MQTT_ROUTER_SIZE
+#define MQTT_ROUTER_SIZE 32
+#endif
+
+#include <Arduino.h>
+#include <MongooseString.h>
+
+typedef void (*MqttRouteHandler)(MongooseString payload);
+
+// Maps the subscribed topics to their handlers with a hash table built when
+// connecting, so an incoming message is dispatched without copying the topic
+class MqttRouter
+{
+  private:
+    struct Route {
+      uint32_t hash;
+      String topic;
+      MqttRouteHandler handler;
+    };
+
+    Route _routes[MQTT_ROUTER_SIZE];
+    uint8_t _count;
+
+    Route *find(const char *topic, size_t length, uint32_t hash);
+
+  public:
+    MqttRouter();
+
+    void clear();
+
+    // Route topic to handler, empty topics and topics already routed are ignored
+    bool on(const String &topic, MqttRouteHandler handler);
+
+    // Returns false if no handler is routed for topic
+    bool dispatch(MongooseString topic, MongooseString payload);
+
+    // Payload conversions matching String::toInt() and String::toFloat()
+    static long toInt(MongooseString payload);
+    static double toFloat(MongooseString payload);
+};
+
+#endif // _OPENEVSE_MQTT_ROUTER_H
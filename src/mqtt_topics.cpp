@@ -0,0 +1,184 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_MQTT)
+#undef ENABLE_DEBUG
+#endif
+
+#include "mqtt_topics.h"
+#include "mqtt_publish_cache.h"
+#include "debug.h"
+
+// The keys regularly published by mqtt_publish(), NULL terminated
+const char * const MqttTopicTable::_keys[] = {
+  // create_rapi_json()
+  "evse_connected",
+  "rfid_auth",
+  "amp",
+  "voltage",
+  "power",
+  "pilot",
+  "max_current",
+  "temp",
+  "temp_max",
+  "temp1",
+  "temp2",
+  "temp3",
+  "temp4",
+  "state",
+  "status",
+  "flags",
+  "vehicle",
+  "colour",
+  "manual_override",
+  "freeram",
+  "divertmode",
+  "srssi",
+  "time",
+  "local_time",
+  "offset",
+
+  // Energy meter
+  "session_energy",
+  "session_elapsed",
+  "total_energy",
+  "total_day",
+  "total_week",
+  "total_month",
+  "total_year",
+  "total_switches",
+  "imported",
+
+  // Solar divert
+  "divert_update",
+  "grid_ie",
+  "solar",
+  "divert_active",
+  "charge_rate",
+  "trigger_current",
+  "available_current",
+  "smoothed_available_current",
+  "min_charge_end",
+
+  // Current shaper
+  "shaper",
+  "shaper_live_pwr",
+  "shaper_smoothed_live_pwr",
+  "shaper_max_pwr",
+  "shaper_cur",
+  "shaper_updated",
+
+  // Claims and vehicle
+  "claims_version",
+  "override_version",
+  "schedule_version",
+  "schedule_plan_version",
+  "limit_version",
+  "battery_level",
+  "battery_range",
+  "time_to_full_charge",
+  "vehicle_state_update",
+
+  "mqtt_connected",
+  NULL
+};
+
+MqttTopicTable::MqttTopicTable() :
+  _base(),
+  _buffer(NULL),
+  _topics(NULL),
+  _hashes(NULL),
+  _slots()
+{
+  _scratch[0] = '\0';
+}
+
+MqttTopicTable::~MqttTopicTable()
+{
+  delete[] _buffer;
+  delete[] _topics;
+  delete[] _hashes;
+}
+
+void MqttTopicTable::begin(const String &base)
+{
+  if(_buffer && base == _base) {
+    return;
+  }
+
+  size_t count = 0;
+  size_t size = 0;
+  for(; _keys[count]; count++) {
+    size += base.length() + 1 + strlen(_keys[count]) + 1;
+  }
+
+  delete[] _buffer;
+  delete[] _topics;
+  delete[] _hashes;
+  _buffer = new char[size];
+  _topics = new const char *[count];
+  _hashes = new uint32_t[count];
+  _base = base;
+  memset(_slots, 0, sizeof(_slots));
+
+  char *pos = _buffer;
+  for(size_t i = 0; i < count; i++)
+  {
+    _topics[i] = pos;
+    _hashes[i] = MqttPublishCache::hash(_keys[i], strlen(_keys[i]));
+
+    // Open addressing with linear probing, keeping a free slot so a miss always
+    // terminates. Any keys past that are built like unknown keys.
+    if(i < MQTT_TOPIC_TABLE_SIZE - 1)
+    {
+      uint32_t slot = _hashes[i];
+      while(0 != _slots[slot & (MQTT_TOPIC_TABLE_SIZE - 1)]) {
+        slot++;
+      }
+      _slots[slot & (MQTT_TOPIC_TABLE_SIZE - 1)] = i + 1;
+    }
+
+    memcpy(pos, base.c_str(), base.length());
+    pos += base.length();
+    *pos++ = '/';
+    strcpy(pos, _keys[i]);
+    pos += strlen(_keys[i]) + 1;
+  }
+
+  DBUGF("Built %d MQTT topics, %d bytes", count, size);
+}
+
+int MqttTopicTable::find(const char *key, uint32_t hash)
+{
+  if(_hashes)
+  {
+    // An empty slot ends the search
+    for(uint32_t i = 0; i < MQTT_TOPIC_TABLE_SIZE; i++)
+    {
+      uint8_t slot = _slots[(hash + i) & (MQTT_TOPIC_TABLE_SIZE - 1)];
+      if(0 == slot) {
+        break;
+      }
+
+      int index = slot - 1;
+      if(hash == _hashes[index] && 0 == strcmp(key, _keys[index])) {
+        return index;
+      }
+    }
+  }
+
+  return -1;
+}
+
+const char *MqttTopicTable::get(const char *key, uint32_t hash)
+{
+  int index = find(key, hash);
+  if(index >= 0) {
+    return _topics[index];
+  }
+
+  int length = snprintf(_scratch, sizeof(_scratch), "%s/%s", _base.c_str(), key);
+  if(length < 0 || length >= (int)sizeof(_scratch))
+  {
+    DBUGF("MQTT topic for %s is too long", key);
+    return NULL;
+  }
+  return _scratch;
+}
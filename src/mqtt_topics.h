@@ -0,0 +1,48 @@
+#ifndef _OPENEVSE_MQTT_TOPICS_H
+#define _OPENEVSE_MQTT_TOPICS_H
+
+// Longest topic built for a key not in the table, longer topics are not published
+#ifndef MQTT_TOPIC_MAX_LENGTH
+#define MQTT_TOPIC_MAX_LENGTH 128
+#endif
+
+// Number of slots in the key index, must be a power of 2 no more than 256 and
+// larger than the number of keys in the table
+#ifndef MQTT_TOPIC_TABLE_SIZE
+#define MQTT_TOPIC_TABLE_SIZE 128
+#endif
+
+#include <Arduino.h>
+
+// The <mqtt_topic>/<key> topics for the known status keys, built once per base
+// topic so publishing a key does not need to allocate. The keys are found by
+// their hash with the same open addressed table as MqttRouter.
+class MqttTopicTable
+{
+  private:
+    static const char * const _keys[];
+
+    String _base;
+    char *_buffer;
+    const char **_topics;
+    uint32_t *_hashes;
+    // The index + 1 of the key in each slot, 0 if the slot is empty
+    uint8_t _slots[MQTT_TOPIC_TABLE_SIZE];
+    char _scratch[MQTT_TOPIC_MAX_LENGTH];
+
+    int find(const char *key, uint32_t hash);
+
+  public:
+    MqttTopicTable();
+    ~MqttTopicTable();
+
+    // Build the topics under base, does nothing if base has not changed
+    void begin(const String &base);
+
+    // The topic for key, hash is MqttPublishCache::hash() of the key. Unknown keys
+    // are built in a scratch buffer that is only valid until the next call, NULL
+    // if the topic would be longer than MQTT_TOPIC_MAX_LENGTH.
+    const char *get(const char *key, uint32_t hash);
+};
+
+#endif // _OPENEVSE_MQTT_TOPICS_H
@@ -633,11 +633,13 @@ void OcppTask::initializeDiagnosticsService() {
             for (uint32_t i = 0; i <= (eventLog->getMaxIndex() - eventLog->getMinIndex()) && !overflow; i++) {
                 uint32_t index = eventLog->getMinIndex() + i;
 
-                eventLog->enumerate(index, [this, startTime, stopTime, &body, SUFFIX_RESERVED_AREA, &firstEntry, &overflow] (String time, EventType type, const String &logEntry, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper) {
+                eventLog->enumerate(index, [this, startTime, stopTime, &body, SUFFIX_RESERVED_AREA, &firstEntry, &overflow] (const EventLogEntry &entry) {
                     if (overflow) return;
+                    char time[32];
+                    entry.formatTime(time, sizeof(time));
                     MicroOcpp::Timestamp timestamp = MicroOcpp::Timestamp();
-                    if (time.isEmpty() || !timestamp.setTime(time.c_str())) {
-                        DBUGF("[ocpp] Diagnostics upload, cannot parse timestamp format: %s", time.c_str());
+                    if (!timestamp.setTime(time)) {
+                        DBUGF("[ocpp] Diagnostics upload, cannot parse timestamp format: %s", time);
                         return;
                     }
 
@@ -645,6 +647,23 @@ void OcppTask::initializeDiagnosticsService() {
                         return;
                     }
 
+                    //same format the event log was stored in before it was binary
+                    StaticJsonDocument<256> line;
+                    line["t"] = time;
+                    line["ty"] = entry.type;
+                    line["ms"] = entry.getManagerState().toString();
+                    line["es"] = entry.evseState;
+                    line["ef"] = entry.evseFlags;
+                    line["p"] = entry.pilot;
+                    line["e"] = entry.energy;
+                    line["el"] = entry.elapsed;
+                    line["tp"] = entry.getTemperature();
+                    line["tm"] = entry.getTemperatureMax();
+                    line["dm"] = entry.divertMode;
+                    line["sh"] = entry.shaper;
+                    String logEntry;
+                    serializeJson(line, logEntry);
+
                     if (body.length() + logEntry.length() + 10 < SUFFIX_RESERVED_AREA) {
                         if (firstEntry)
                             firstEntry = false;
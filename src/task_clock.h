@@ -0,0 +1,14 @@
+#ifndef _OPENEVSE_TASK_CLOCK_H
+#define _OPENEVSE_TASK_CLOCK_H
+
+// The delay a task returns from loop() is passed through TASK_CLOCK_SCHEDULE so
+// divert_sim can advance its clock to the times MicroTasks would run the task,
+// on the device it is just the delay
+#ifdef DIVERT_SIM
+unsigned long task_clock_schedule(const void *task, unsigned long delay);
+#define TASK_CLOCK_SCHEDULE(task, delay) task_clock_schedule(task, delay)
+#else
+#define TASK_CLOCK_SCHEDULE(task, delay) (delay)
+#endif
+
+#endif // _OPENEVSE_TASK_CLOCK_H
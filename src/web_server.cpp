@@ -26,6 +26,7 @@ typedef const __FlashStringHelper *fstr_t;
 
 #include "emonesp.h"
 #include "web_server.h"
+#include "web_server_ws.h"
 #include "web_server_static.h"
 #include "app_config.h"
 #include "net_manager.h"
@@ -34,6 +35,7 @@ typedef const __FlashStringHelper *fstr_t;
 #include "input.h"
 #include "emoncms.h"
 #include "divert.h"
+#include "meter_mailbox.h"
 #include "lcd.h"
 #include "espal.h"
 #include "time_man.h"
@@ -440,36 +442,29 @@ void handleStatusPost(MongooseHttpServerRequest *request, MongooseHttpServerResp
   {
     bool send_event = true;
 
+    // The meter inputs are picked up by the divert and shaper tasks
     if(doc.containsKey("voltage"))
     {
       double volts = doc["voltage"];
       DBUGF("voltage:%.1f", volts);
-      evse.setVoltage(volts);
+      meterMailbox.post(MeterInput_Voltage, volts);
     }
     if(doc.containsKey("shaper_live_pwr"))
     {
       double shaper_live_pwr = doc["shaper_live_pwr"];
-      shaper.setLivePwr(shaper_live_pwr);
-      DBUGF("shaper: live power:%dW", shaper.getLivePwr());
+      DBUGF("shaper: live power:%.0fW", shaper_live_pwr);
+      meterMailbox.post(MeterInput_LivePwr, shaper_live_pwr);
     }
     if(doc.containsKey("solar")) {
-      solar = doc["solar"];
+      int solar = doc["solar"];
       DBUGF("solar:%dW", solar);
-      divert.update_state();
-      // recalculate shaper
-      if (shaper.getState()) {
-        shaper.shapeCurrent();
-      }
+      meterMailbox.post(MeterInput_Solar, solar);
       send_event = false; // Divert sends the event so no need to send here
     }
     else if(doc.containsKey("grid_ie")) {
-      grid_ie = doc["grid_ie"];
+      int grid_ie = doc["grid_ie"];
       DBUGF("grid:%dW", grid_ie);
-      divert.update_state();
-      // recalculate shaper
-      if (shaper.getState()) {
-        shaper.shapeCurrent();
-      }
+      meterMailbox.post(MeterInput_GridIe, grid_ie);
       send_event = false; // Divert sends the event so no need to send here
     }
     if(doc.containsKey("battery_level") && vehicle_data_src == VEHICLE_DATA_SRC_HTTP) {
@@ -1142,9 +1137,9 @@ void handleHttpsRedirect(MongooseHttpServerRequest *request)
 void onWsFrame(MongooseHttpWebSocketConnection *connection, int flags, uint8_t *data, size_t len)
 {
   DBUGF("Got message %.*s", len, (const char *)data);
-  const size_t capacity = JSON_OBJECT_SIZE(1) + 16;
+  const size_t capacity = JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(WebSocketTopic_Count) + 128;
   DynamicJsonDocument doc(capacity);
-  DeserializationError error = deserializeJson(doc, data, len);
+  DeserializationError error = deserializeJson(doc, (const char *)data, len);
   if (!error) {
     if (doc.containsKey("ping") && doc["ping"].is<int8_t>())
       {
@@ -1152,6 +1147,10 @@ void onWsFrame(MongooseHttpWebSocketConnection *connection, int flags, uint8_t *
         connection->send("{\"pong\": 1}");
 
       }
+    if (doc["subscribe"].is<JsonArray>())
+      {
+        webSocketEvents.subscribe(connection, doc["subscribe"].as<JsonArrayConst>());
+      }
   }
 }
 
@@ -1162,7 +1161,7 @@ void onWsConnect(MongooseHttpWebSocketConnection *connection)
   const size_t capacity = JSON_OBJECT_SIZE(40) + 1024;
   DynamicJsonDocument doc(capacity);
   buildStatus(doc);
-  web_server_event(doc);
+  webSocketEvents.onConnect(connection, doc);
 }
 
 /*
@@ -1286,7 +1285,12 @@ void web_server_setup()
   server.on("/ws$")->
     onFrame(onWsFrame)
     ->
-    onConnect(onWsConnect);
+    onConnect(onWsConnect)
+    ->
+    onClose([](MongooseHttpServerRequest *request) {
+      webSocketEvents.onClose(request);
+    });
+  webSocketEvents.begin();
 
   server.onNotFound(handleNotFound);
 
@@ -1312,9 +1316,7 @@ web_server_loop() {
   Profile_End(web_server_loop, 5);
 }
 
-void web_server_event(JsonDocument &event)
+void web_server_event(JsonDocument &event, const char *json, size_t length)
 {
-  String json;
-  serializeJson(event, json);
-  server.sendAll("/ws", json);
+  webSocketEvents.send(event, json, length);
 }
@@ -46,7 +46,8 @@ extern MongooseHttpServer server;
 extern void web_server_setup();
 extern void web_server_loop();
 
-extern void web_server_event(JsonDocument &event);
+// json, if given, is event already serialised
+extern void web_server_event(JsonDocument &event, const char *json = NULL, size_t length = 0);
 
 typedef const __FlashStringHelper *fstr_t;
 
@@ -15,6 +15,125 @@ typedef const __FlashStringHelper *fstr_t;
 // /events
 #define LOG_BASE_LEN 6
 
+static void serializeEvent(const EventLogEntry &entry, MongooseHttpServerResponseStream *response)
+{
+  StaticJsonDocument<1024> event;
+
+  char time[32];
+  entry.formatTime(time, sizeof(time));
+
+  event["time"] = time;
+  event["type"] = entry.getType().toString();
+  event["managerState"] = entry.getManagerState().toString();
+  event["evseState"] = entry.evseState;
+  event["evseFlags"] = entry.evseFlags;
+  event["pilot"] = entry.pilot;
+  event["energy"] = entry.energy;
+  event["elapsed"] = entry.elapsed;
+  event["temperature"] = entry.getTemperature();
+  event["temperatureMax"] = entry.getTemperatureMax();
+  event["divertMode"] = entry.divertMode;
+  event["shaper"] = entry.shaper == true?1:0;
+  serializeJson(event, *response);
+}
+
+// Parse a time given as epoch seconds or UTC ISO 8601, eg 2023-01-01T12:00:00Z.
+// A date on its own is the start of the day, or the end if endOfDay is set.
+static bool parseTime(const String &value, bool endOfDay, uint32_t &time)
+{
+  const char *str = value.c_str();
+  char *end;
+  unsigned long epoch = strtoul(str, &end, 10);
+  if(end != str && '\0' == *end)
+  {
+    time = epoch;
+    return true;
+  }
+
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  int fields = sscanf(str, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second);
+  if(fields < 3 || year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+    return false;
+  }
+
+  time = EventLogEntry::timeFromCivil(year, month, day, hour, minute, second);
+  if(3 == fields && endOfDay) {
+    time += 86400 - 1;
+  }
+  return true;
+}
+
+// Parse a comma separated list of event types, eg warning,notification
+static bool parseTypes(const String &value, uint8_t &typeMask)
+{
+  typeMask = 0;
+
+  String list = value + ",";
+  int start = 0;
+  for(int comma = list.indexOf(',');
+      comma >= 0;
+      start = comma + 1, comma = list.indexOf(',', start))
+  {
+    String name = list.substring(start, comma);
+    name.trim();
+    if(0 == name.length()) {
+      continue;
+    }
+
+    bool found = false;
+    for(uint8_t i = EventType::Information; i <= EventType::Warning; i++)
+    {
+      EventType type = (EventType::Value)i;
+      if(name == type.toString())
+      {
+        typeMask |= EVENTLOG_TYPE_MASK(i);
+        found = true;
+      }
+    }
+    if(!found) {
+      return false;
+    }
+  }
+
+  return 0 != typeMask;
+}
+
+// -------------------------------------------------------------------
+// Events between two times, /logs?from=&to=&type=
+// -------------------------------------------------------------------
+static void handleEventLogQuery(MongooseHttpServerRequest *request, MongooseHttpServerResponseStream *response)
+{
+  uint32_t from = 0;
+  uint32_t to = UINT32_MAX;
+  uint8_t typeMask = EVENTLOG_TYPES_ALL;
+
+  if((request->hasParam("from") && !parseTime(request->getParam("from"), false, from)) ||
+     (request->hasParam("to") && !parseTime(request->getParam("to"), true, to)) ||
+     (request->hasParam("type") && !parseTypes(request->getParam("type"), typeMask)))
+  {
+    response->setCode(400);
+    response->print("{\"msg\":\"Invalid from, to or type\"}");
+    return;
+  }
+
+  DBUGF("Log query %u-%u, types %x", from, to, typeMask);
+
+  response->setCode(200);
+  int count = 0;
+
+  response->print("[");
+
+  eventLog.query(from, to, typeMask, [&count, response](const EventLogEntry &entry)
+  {
+    if(count++ > 0) {
+      response->print(",");
+    }
+    serializeEvent(entry, response);
+  });
+
+  response->print("]");
+}
+
 // -------------------------------------------------------------------
 // Download event file.
 // -------------------------------------------------------------------
@@ -44,27 +163,12 @@ void handleEventLogs(MongooseHttpServerRequest *request)
 
         response->print("[");
 
-        eventLog.enumerate(block, [&count, response](String time, EventType type, const String &logEntry, EvseState managerState, uint8_t evseState, uint32_t evseFlags, uint32_t pilot, double energy, uint32_t elapsed, double temperature, double temperatureMax, uint8_t divertMode, uint8_t shaper)
+        eventLog.enumerate(block, [&count, response](const EventLogEntry &entry)
         {
-          StaticJsonDocument<1024> event;
-
           if(count++ > 0) {
             response->print(",");
           }
-
-          event["time"] = time;
-          event["type"] = type.toString();
-          event["managerState"] = managerState.toString();
-          event["evseState"] = evseState;
-          event["evseFlags"] = evseFlags;
-          event["pilot"] = pilot;
-          event["energy"] = energy;
-          event["elapsed"] = elapsed;
-          event["temperature"] = temperature;
-          event["temperatureMax"] = temperatureMax;
-          event["divertMode"] = divertMode;
-          event["shaper"] = shaper == true?1:0;
-          serializeJson(event, *response);
+          serializeEvent(entry, response);
         });
 
         response->print("]");
@@ -74,6 +178,10 @@ void handleEventLogs(MongooseHttpServerRequest *request)
         response->print("{\"msg\":\"Block out of range\"}");
       }
     }
+    else if(request->hasParam("from") || request->hasParam("to") || request->hasParam("type"))
+    {
+      handleEventLogQuery(request, response);
+    }
     else
     {
       StaticJsonDocument<1024> doc;
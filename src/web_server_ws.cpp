@@ -0,0 +1,465 @@
+#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_WEB)
+#undef ENABLE_DEBUG
+#endif
+
+#include "web_server_ws.h"
+#include "debug.h"
+
+WebSocketEventsTask webSocketEvents;
+
+// Keys that change what the UI shows for the charging state, sent without waiting.
+// The OTA progress is also sent straight away as the update blocks the task loop.
+static const char * const priority_keys[] = {
+  "state",
+  "status",
+  "vehicle",
+  "manual_override",
+  "divertmode",
+  "ota",
+  "ota_progress"
+};
+
+const char * const WebSocketEventsTask::_topicNames[WebSocketTopic_Count] = {
+  "status",
+  "divert",
+  "shaper",
+  "energy",
+  "claims",
+  "debug"
+};
+
+// The keys that are not part of the EVSE status, anything not listed here is status
+static const struct {
+  const char *key;
+  WebSocketTopic topic;
+} topic_keys[] = {
+  { "divertmode", WebSocketTopic_Divert },
+  { "divert_update", WebSocketTopic_Divert },
+  { "divert_active", WebSocketTopic_Divert },
+  { "grid_ie", WebSocketTopic_Divert },
+  { "solar", WebSocketTopic_Divert },
+  { "charge_rate", WebSocketTopic_Divert },
+  { "trigger_current", WebSocketTopic_Divert },
+  { "available_current", WebSocketTopic_Divert },
+  { "smoothed_available_current", WebSocketTopic_Divert },
+  { "min_charge_end", WebSocketTopic_Divert },
+
+  { "shaper", WebSocketTopic_Shaper },
+  { "shaper_live_pwr", WebSocketTopic_Shaper },
+  { "shaper_smoothed_live_pwr", WebSocketTopic_Shaper },
+  { "shaper_max_pwr", WebSocketTopic_Shaper },
+  { "shaper_cur", WebSocketTopic_Shaper },
+  { "shaper_updated", WebSocketTopic_Shaper },
+
+  { "session_energy", WebSocketTopic_Energy },
+  { "session_elapsed", WebSocketTopic_Energy },
+  { "total_energy", WebSocketTopic_Energy },
+  { "total_day", WebSocketTopic_Energy },
+  { "total_week", WebSocketTopic_Energy },
+  { "total_month", WebSocketTopic_Energy },
+  { "total_year", WebSocketTopic_Energy },
+  { "total_switches", WebSocketTopic_Energy },
+  { "imported", WebSocketTopic_Energy },
+
+  { "claims_version", WebSocketTopic_Claims },
+  { "override_version", WebSocketTopic_Claims },
+  { "schedule_version", WebSocketTopic_Claims },
+  { "schedule_plan_version", WebSocketTopic_Claims },
+  { "limit_version", WebSocketTopic_Claims },
+
+  { "free_heap", WebSocketTopic_Debug },
+  { "freeram", WebSocketTopic_Debug },
+  { "comm_sent", WebSocketTopic_Debug },
+  { "comm_success", WebSocketTopic_Debug },
+  { "packets_sent", WebSocketTopic_Debug },
+  { "packets_success", WebSocketTopic_Debug }
+};
+
+char *WebSocketClient::_frame = NULL;
+size_t WebSocketClient::_frameSize = 0;
+size_t WebSocketClient::_frameLength = 0;
+uint8_t WebSocketClient::_frameTopics = 0;
+uint32_t WebSocketClient::_frameFirst = 0;
+uint32_t WebSocketClient::_frameLast = 0;
+
+WebSocketClient::WebSocketClient(MongooseHttpWebSocketConnection *connection) :
+  _connection(connection),
+  _pending(NULL),
+  _firstPending(0),
+  _pendingFirst(0),
+  _pendingLast(0),
+  _pendingTopics(0),
+  _topics(WEB_SERVER_WS_TOPICS_ALL),
+  _budget(WEB_SERVER_WS_CLIENT_BUDGET),
+  _lastRefill(millis()),
+  _next(NULL)
+{
+}
+
+WebSocketClient::~WebSocketClient()
+{
+  delete _pending;
+}
+
+void WebSocketClient::refill()
+{
+  unsigned long now = millis();
+  long tokens = ((now - _lastRefill) * WEB_SERVER_WS_CLIENT_RATE) / 1000;
+  if(tokens > 0)
+  {
+    _budget += tokens;
+    if(_budget > WEB_SERVER_WS_CLIENT_BUDGET) {
+      _budget = WEB_SERVER_WS_CLIENT_BUDGET;
+    }
+    _lastRefill = now;
+  }
+}
+
+void WebSocketClient::sendFrame(JsonDocument &doc, uint32_t first, uint32_t last)
+{
+  if(0 == first || first != _frameFirst || last != _frameLast || _pendingTopics != _frameTopics)
+  {
+    size_t length = measureJson(doc);
+    if(length + 1 > _frameSize)
+    {
+      char *frame = (char *)realloc(_frame, length + 1);
+      if(NULL == frame) {
+        DBUGF("ws frame of %d bytes dropped", length);
+        return;
+      }
+      _frame = frame;
+      _frameSize = length + 1;
+    }
+
+    _frameLength = serializeJson(doc, _frame, _frameSize);
+    _frameTopics = _pendingTopics;
+    _frameFirst = first;
+    _frameLast = last;
+  }
+
+  _connection->send(WEBSOCKET_OP_TEXT, _frame, _frameLength);
+
+  // A frame bigger than the remaining budget is still sent, the client then has
+  // to wait for the budget to refill before the next one
+  refill();
+  _budget -= _frameLength;
+}
+
+void WebSocketClient::cacheFrame(const char *json, size_t length, uint8_t topics, uint32_t sequence)
+{
+  if(length + 1 > _frameSize)
+  {
+    char *frame = (char *)realloc(_frame, length + 1);
+    if(NULL == frame) {
+      return;
+    }
+    _frame = frame;
+    _frameSize = length + 1;
+  }
+
+  memcpy(_frame, json, length);
+  _frame[length] = '\0';
+  _frameLength = length;
+  _frameTopics = topics;
+  _frameFirst = sequence;
+  _frameLast = sequence;
+}
+
+void WebSocketClient::send(JsonDocument &event)
+{
+  sendFrame(event, 0, 0);
+}
+
+// The pending document is freed once sent, so an idle client costs no more than
+// the WebSocketClient
+void WebSocketClient::sendPending()
+{
+  sendFrame(*_pending, _pendingFirst, _pendingLast);
+  delete _pending;
+  _pending = NULL;
+}
+
+void WebSocketClient::removePending(JsonDocument &event)
+{
+  if(NULL == _pending) {
+    return;
+  }
+
+  for(JsonPairConst kv : event.as<JsonObjectConst>()) {
+    _pending->remove(kv.key().c_str());
+  }
+}
+
+void WebSocketClient::merge(JsonDocument &event, uint8_t topics, uint32_t sequence)
+{
+  // The strings are copied so allow for them as well as the slots
+  size_t needed = event.memoryUsage() + measureJson(event);
+
+  if(needed > WEB_SERVER_WS_PENDING_SIZE)
+  {
+    // Too big to merge, the pending values of its keys are older so drop them
+    removePending(event);
+    if(false == hasPending()) {
+      delete _pending;
+      _pending = NULL;
+    }
+    // What is left is no longer all of the events merged
+    _pendingFirst = 0;
+    send(event);
+    return;
+  }
+
+  // ArduinoJson does not reclaim replaced values, so make room before the pool runs
+  // out. If the client is over budget the values about to be replaced are removed
+  // and the space reclaimed, so everything pending is kept.
+  if(NULL != _pending && _pending->memoryUsage() + needed > _pending->capacity() && !flush())
+  {
+    removePending(event);
+    _pending->garbageCollect();
+
+    // Still no room, send the latest values anyway rather than lose any
+    if(_pending->memoryUsage() + needed > _pending->capacity()) {
+      sendPending();
+    }
+  }
+
+  if(NULL == _pending)
+  {
+    _pending = new DynamicJsonDocument(WEB_SERVER_WS_PENDING_SIZE);
+    if(0 == _pending->capacity())
+    {
+      DBUGLN("No memory for ws pending events");
+      delete _pending;
+      _pending = NULL;
+      send(event);
+      return;
+    }
+  }
+
+  if(false == hasPending()) {
+    _firstPending = millis();
+    _pendingFirst = sequence;
+    _pendingTopics = 0;
+  }
+  if(0 != _pendingFirst) {
+    _pendingLast = sequence;
+  }
+  _pendingTopics |= topics & _topics;
+
+  bool all = 0 == (topics & ~_topics);
+  for(JsonPairConst kv : event.as<JsonObjectConst>())
+  {
+    if(all || (_topics & WEB_SERVER_WS_TOPIC_MASK(WebSocketEventsTask::getTopic(kv.key().c_str()))))
+    {
+      // Store copies, the event's strings may not outlive it (char * is copied,
+      // const char * is linked)
+      char *key = (char *)kv.key().c_str();
+      JsonVariantConst value = kv.value();
+      if(value.is<const char *>()) {
+        (*_pending)[key] = (char *)value.as<const char *>();
+      } else if(value.is<JsonObjectConst>() || value.is<JsonArrayConst>()) {
+        String json;
+        serializeJson(value, json);
+        (*_pending)[key] = serialized(json);
+      } else {
+        (*_pending)[key] = value;
+      }
+    }
+  }
+}
+
+bool WebSocketClient::flush()
+{
+  if(hasPending())
+  {
+    refill();
+    if(_budget <= 0) {
+      return false;
+    }
+
+    sendPending();
+  }
+
+  return true;
+}
+
+WebSocketEventsTask::WebSocketEventsTask() :
+  MicroTasks::Task(),
+  _clients(NULL),
+  _sequence(0),
+  _running(false)
+{
+}
+
+void WebSocketEventsTask::begin()
+{
+  MicroTask.startTask(this);
+  _running = true;
+}
+
+void WebSocketEventsTask::setup()
+{
+}
+
+unsigned long WebSocketEventsTask::loop(MicroTasks::WakeReason reason)
+{
+  unsigned long next = MicroTask.Infinate;
+  unsigned long now = millis();
+
+  for(WebSocketClient *client = _clients; client; client = client->_next)
+  {
+    if(client->hasPending())
+    {
+      unsigned long age = now - client->_firstPending;
+      unsigned long wait;
+      if(age >= WEB_SERVER_WS_FLUSH_TIME)
+      {
+        if(client->flush()) {
+          continue;
+        }
+        // Over budget, try again once there is some budget back
+        wait = ((1 - client->_budget) * 1000) / WEB_SERVER_WS_CLIENT_RATE + 1;
+      } else {
+        wait = WEB_SERVER_WS_FLUSH_TIME - age;
+      }
+
+      if(wait < next) {
+        next = wait;
+      }
+    }
+  }
+
+  return next;
+}
+
+bool WebSocketEventsTask::isPriority(JsonDocument &event)
+{
+  for(const char *key : priority_keys)
+  {
+    if(event.containsKey(key)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+WebSocketTopic WebSocketEventsTask::getTopic(const char *key)
+{
+  for(auto &entry : topic_keys)
+  {
+    if(0 == strcmp(entry.key, key)) {
+      return entry.topic;
+    }
+  }
+  return WebSocketTopic_Status;
+}
+
+uint8_t WebSocketEventsTask::getTopics(JsonDocument &event)
+{
+  uint8_t topics = 0;
+  for(JsonPairConst kv : event.as<JsonObjectConst>()) {
+    topics |= WEB_SERVER_WS_TOPIC_MASK(getTopic(kv.key().c_str()));
+  }
+  return topics;
+}
+
+WebSocketClient *WebSocketEventsTask::find(MongooseHttpWebSocketConnection *connection)
+{
+  for(WebSocketClient *client = _clients; client; client = client->_next)
+  {
+    if(client->_connection == connection) {
+      return client;
+    }
+  }
+  return NULL;
+}
+
+void WebSocketEventsTask::onConnect(MongooseHttpWebSocketConnection *connection, JsonDocument &status)
+{
+  WebSocketClient *client = new WebSocketClient(connection);
+  client->_next = _clients;
+  _clients = client;
+
+  client->send(status);
+}
+
+void WebSocketEventsTask::onClose(MongooseHttpServerRequest *request)
+{
+  for(WebSocketClient **ptr = &_clients; *ptr; ptr = &(*ptr)->_next)
+  {
+    WebSocketClient *client = *ptr;
+    if(client->_connection == request)
+    {
+      DBUGF("ws client closed");
+      *ptr = client->_next;
+      delete client;
+      return;
+    }
+  }
+}
+
+bool WebSocketEventsTask::subscribe(MongooseHttpWebSocketConnection *connection, JsonArrayConst topics)
+{
+  WebSocketClient *client = find(connection);
+  if(NULL == client) {
+    return false;
+  }
+
+  uint8_t mask = 0;
+  for(JsonVariantConst topic : topics)
+  {
+    const char *name = topic.as<const char *>();
+    for(uint8_t i = 0; name && i < WebSocketTopic_Count; i++)
+    {
+      if(0 == strcmp(name, _topicNames[i])) {
+        mask |= WEB_SERVER_WS_TOPIC_MASK(i);
+      }
+    }
+  }
+
+  DBUGF("ws client subscribed to %02x", mask);
+  client->_topics = mask;
+  // What is pending was filtered by the old topics
+  client->_pendingFirst = 0;
+  return true;
+}
+
+void WebSocketEventsTask::send(JsonDocument &event, const char *json, size_t length)
+{
+  bool priority = isPriority(event);
+  uint8_t topics = getTopics(event);
+  bool pending = false;
+
+  // 0 is never used so a client's pending state can be marked as not shared
+  if(0 == ++_sequence) {
+    _sequence = 1;
+  }
+
+  // A client that gets all of the event and has nothing else pending sends it as is
+  if(NULL != json) {
+    WebSocketClient::cacheFrame(json, length, topics, _sequence);
+  }
+
+  for(WebSocketClient *client = _clients; client; client = client->_next)
+  {
+    if(client->_topics & topics)
+    {
+      client->merge(event, topics, _sequence);
+      if(priority) {
+        client->flush();
+      }
+    }
+    pending |= client->hasPending();
+  }
+
+  if(pending && _running) {
+    MicroTask.wakeTask(this);
+  }
+}
+
+void WebSocketEventsTask::flush()
+{
+  for(WebSocketClient *client = _clients; client; client = client->_next) {
+    client->flush();
+  }
+}
@@ -0,0 +1,157 @@
+#ifndef _EMONESP_WEB_SERVER_WS_H
+#define _EMONESP_WEB_SERVER_WS_H
+
+// How long events are coalesced before being sent to a client (ms)
+#ifndef WEB_SERVER_WS_FLUSH_TIME
+#define WEB_SERVER_WS_FLUSH_TIME 200
+#endif
+
+// Size of the per client document the pending events are merged into, only
+// allocated while a client has something pending
+#ifndef WEB_SERVER_WS_PENDING_SIZE
+#define WEB_SERVER_WS_PENDING_SIZE 2048
+#endif
+
+// The burst of bytes a client can be sent before frames are held back
+#ifndef WEB_SERVER_WS_CLIENT_BUDGET
+#define WEB_SERVER_WS_CLIENT_BUDGET 8192
+#endif
+
+// The rate the byte budget is refilled at (bytes/s)
+#ifndef WEB_SERVER_WS_CLIENT_RATE
+#define WEB_SERVER_WS_CLIENT_RATE 2048
+#endif
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <MicroTasks.h>
+#include <MongooseHttpServer.h>
+
+// The groups of event keys a client can subscribe to, the order must match the
+// names in web_server_ws.cpp
+enum WebSocketTopic : uint8_t
+{
+  WebSocketTopic_Status,
+  WebSocketTopic_Divert,
+  WebSocketTopic_Shaper,
+  WebSocketTopic_Energy,
+  WebSocketTopic_Claims,
+  WebSocketTopic_Debug,
+
+  WebSocketTopic_Count
+};
+
+#define WEB_SERVER_WS_TOPIC_MASK(topic) (1 << (topic))
+#define WEB_SERVER_WS_TOPICS_ALL ((1 << WebSocketTopic_Count) - 1)
+
+// The state sent to a /ws client but not yet flushed
+class WebSocketClient
+{
+  friend class WebSocketEventsTask;
+
+  private:
+    MongooseHttpWebSocketConnection *_connection;
+    DynamicJsonDocument *_pending;
+    unsigned long _firstPending;
+    // The sequence numbers of the first and last event merged into _pending, 0 if
+    // the pending state can not be shared with other clients
+    uint32_t _pendingFirst;
+    uint32_t _pendingLast;
+    // The topics of the keys in _pending
+    uint8_t _pendingTopics;
+    uint8_t _topics;
+    long _budget;
+    unsigned long _lastRefill;
+    WebSocketClient *_next;
+
+    // Frames are serialized into the one buffer, grown to the largest frame. Clients
+    // whose pending state has the keys of the same topics from the same events send
+    // the same frame, so it is only serialized once.
+    static char *_frame;
+    static size_t _frameSize;
+    static size_t _frameLength;
+    static uint8_t _frameTopics;
+    static uint32_t _frameFirst;
+    static uint32_t _frameLast;
+
+    // Merge the keys of event in topics into the pending state, later values
+    // replace earlier. sequence is the number of the event.
+    void merge(JsonDocument &event, uint8_t topics, uint32_t sequence);
+
+    // Send the pending state if the byte budget allows, returns false if it was
+    // held back
+    bool flush();
+    void sendPending();
+    void send(JsonDocument &event);
+    void sendFrame(JsonDocument &doc, uint32_t first, uint32_t last);
+    void refill();
+
+    // Use an event already serialized as the frame of the clients that only have
+    // that event pending
+    static void cacheFrame(const char *json, size_t length, uint8_t topics, uint32_t sequence);
+
+    bool hasPending() {
+      return NULL != _pending && _pending->size() > 0;
+    }
+
+    // Drop the pending keys that are also in event
+    void removePending(JsonDocument &event);
+
+  public:
+    WebSocketClient(MongooseHttpWebSocketConnection *connection);
+    ~WebSocketClient();
+};
+
+// Coalesces the events sent to the /ws clients, so a burst of events (eg a grid_ie
+// update, the resulting divert and claim events and the EVSE state change) is sent
+// as one frame per flush interval. Events that change the charging state are sent
+// straight away.
+//
+// Clients only get the topics they have subscribed to, all by default, and each
+// client has a byte budget. A client that has used its budget is not sent anything
+// until it refills, its pending state keeps being updated so it gets the latest
+// values rather than every intermediate one.
+class WebSocketEventsTask : public MicroTasks::Task
+{
+  private:
+    WebSocketClient *_clients;
+    uint32_t _sequence;
+    bool _running;
+
+    static const char * const _topicNames[WebSocketTopic_Count];
+
+    static bool isPriority(JsonDocument &event);
+    static uint8_t getTopics(JsonDocument &event);
+
+    WebSocketClient *find(MongooseHttpWebSocketConnection *connection);
+
+  protected:
+    void setup();
+    unsigned long loop(MicroTasks::WakeReason reason);
+
+  public:
+    WebSocketEventsTask();
+
+    void begin();
+
+    // A new client, status is sent to just that client
+    void onConnect(MongooseHttpWebSocketConnection *connection, JsonDocument &status);
+    void onClose(MongooseHttpServerRequest *request);
+
+    // Handle a {"subscribe": ["status", "divert"]} message
+    bool subscribe(MongooseHttpWebSocketConnection *connection, JsonArrayConst topics);
+
+    // The topic a key belongs to
+    static WebSocketTopic getTopic(const char *key);
+
+    // Queue an event for all the clients, json is the event already serialized if
+    // available
+    void send(JsonDocument &event, const char *json = NULL, size_t length = 0);
+
+    // Send all the pending events now
+    void flush();
+};
+
+extern WebSocketEventsTask webSocketEvents;
+
+#endif // _EMONESP_WEB_SERVER_WS_H
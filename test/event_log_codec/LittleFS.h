@@ -0,0 +1,2 @@
+#include "EpoxyFS.h"
+#define LittleFS fs::EpoxyFS
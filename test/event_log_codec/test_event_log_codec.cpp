@@ -0,0 +1,144 @@
+// Host tests for the event log block compression, run with `make test`
+
+#include <Arduino.h>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "event_log_codec.h"
+
+// Bytes checked past the end of the buffer for writes beyond the given size
+#define GUARD_SIZE 16
+#define GUARD_BYTE 0xaa
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if(!(condition)) { \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while(0)
+
+// A session of events, in runs of the same state with the odd change
+static std::vector<EventLogEntry> make_events(size_t count)
+{
+  std::vector<EventLogEntry> events;
+  for(size_t i = 0; i < count; i++)
+  {
+    EventLogEntry entry = {};
+    entry.time = 1700000000 + i * 60;
+    entry.type = 0 == i % 7 ? EventType::Warning : EventType::Information;
+    entry.managerState = i < count / 2 ? EvseState::Active : EvseState::Disabled;
+    entry.evseState = i % 5 ? 3 : 254;
+    entry.evseFlags = 0x100 | (i / 10);
+    entry.pilot = 32;
+    entry.energy = i * 10.5;
+    entry.elapsed = i * 60;
+    entry.temperature = 253 - i % 3;
+    entry.temperatureMax = 0 == i % 11 ? -15 : 401;
+    entry.divertMode = 1;
+    entry.shaper = i % 2;
+    entry.seal();
+    events.push_back(entry);
+  }
+  return events;
+}
+
+// Compress into a buffer of size bytes, returns the length and checks nothing
+// was written past it
+static size_t compress(const std::vector<EventLogEntry> &events, std::vector<uint8_t> &buffer, size_t size)
+{
+  buffer.assign(size + GUARD_SIZE, GUARD_BYTE);
+  size_t length = EventLogCodec::compress(events.data(), events.size(), buffer.data(), size);
+
+  for(size_t i = size; i < size + GUARD_SIZE; i++) {
+    CHECK(GUARD_BYTE == buffer[i]);
+  }
+
+  return length;
+}
+
+// Returns true if the block decodes to exactly the events
+static bool decodes_to(const std::vector<uint8_t> &buffer, size_t length, const std::vector<EventLogEntry> &events)
+{
+  std::vector<EventLogEntry> decoded;
+  bool valid = EventLogCodec::decompress(buffer.data(), length, [&decoded](const EventLogEntry &entry) {
+    decoded.push_back(entry);
+  });
+
+  return valid && decoded.size() == events.size() &&
+         (events.empty() || 0 == memcmp(decoded.data(), events.data(), events.size() * sizeof(EventLogEntry)));
+}
+
+// Every field is decoded as it was logged, and the block is smaller
+static void test_round_trip()
+{
+  std::vector<EventLogEntry> events = make_events(40);
+  std::vector<uint8_t> buffer;
+  size_t length = compress(events, buffer, events.size() * sizeof(EventLogEntry));
+
+  CHECK(length > 0);
+  CHECK(length < events.size() * sizeof(EventLogEntry));
+  CHECK(decodes_to(buffer, length, events));
+}
+
+// A block with no events
+static void test_empty()
+{
+  std::vector<EventLogEntry> events;
+  std::vector<uint8_t> buffer;
+  size_t length = compress(events, buffer, 16);
+
+  CHECK(length > 0);
+  CHECK(decodes_to(buffer, length, events));
+}
+
+// A block that does not fit is not compressed, and nothing is written past it
+static void test_overflow()
+{
+  std::vector<EventLogEntry> events = make_events(40);
+  std::vector<uint8_t> buffer;
+  size_t length = compress(events, buffer, events.size() * sizeof(EventLogEntry));
+  CHECK(length > 2);
+
+  for(size_t size : { (size_t)1, (size_t)8, length - 2, length - 1 }) {
+    CHECK(0 == compress(events, buffer, size));
+  }
+
+  CHECK(length == compress(events, buffer, length));
+  CHECK(decodes_to(buffer, length, events));
+}
+
+// A corrupt block is rejected as a whole
+static void test_corrupt()
+{
+  std::vector<EventLogEntry> events = make_events(40);
+  std::vector<uint8_t> buffer;
+  size_t length = compress(events, buffer, events.size() * sizeof(EventLogEntry));
+
+  buffer[length / 2] ^= 0x01;
+  size_t decoded = 0;
+  CHECK(!EventLogCodec::decompress(buffer.data(), length, [&decoded](const EventLogEntry &entry) {
+    decoded++;
+  }));
+  CHECK(0 == decoded);
+  CHECK(!EventLogCodec::decompress(buffer.data(), 1, [](const EventLogEntry &entry) {}));
+}
+
+int main(int argc, char **argv)
+{
+  test_round_trip();
+  test_empty();
+  test_overflow();
+  test_corrupt();
+
+  if(failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("All event log codec tests passed\n");
+  return EXIT_SUCCESS;
+}